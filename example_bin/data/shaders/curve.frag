@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec2 fragCurve;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Outside the quadratic u^2 - v = 0, interior fan triangles carry
+    // (0,1) and always pass.
+    if (fragCurve.x * fragCurve.x - fragCurve.y > 0.0) {
+        discard;
+    }
+    outColor = vec4(1.0);
+}
@@ -1,20 +1,54 @@
 #include <algorithm>
+#include <cassert>
 #include <iomanip>
 #include <renderer/pipeline.hpp>
+#include <renderer/allocator.hpp>
+#include <renderer/validation.hpp>
+#include <renderer/pacing.hpp>
 #include <parser/parser.hpp>
+#include <parser/glyphcache.hpp>
+#include <parser/textview.hpp>
+#include <jobs/graph.hpp>
+#include <reload/watcher.hpp>
+#include <reload/shadercompiler.hpp>
 #include <fstream>
 #include <format>
 #include "tools/cpp/runfiles/runfiles.h"
 #include <thread>
 #include <ranges>
+#include <map>
+#include <tuple>
 
 using bazel::tools::cpp::runfiles::Runfiles;
 
-const std::vector<Vertex> vertices={
-    {{0.0f,-0.5f},{1.0f,1.0f,1.0f}},
-    {{0.5f,0.0f},{0.0f,1.0f,1.0f}},
-    {{-0.5f,0.0f},{0.0f,0.0f,1.0f}}
-};
+const int windowWidth=600;
+const int windowHeight=500;
+const uint32_t fontSize=48;
+// Extra lines laid out above and below the viewport.
+const uint32_t prefetchLines=8;
+
+static double scrollLines=0.0;
+// Scale from the face's pixel size to the screen, changed with + and -.
+static float zoom=1.0f;
+// Framebuffer size in pixels, follows the swapchain extent.
+static glm::vec2 viewport(windowWidth,windowHeight);
+
+static void scrollCallback(GLFWwindow* window, double xoffset, double yoffset){
+    scrollLines=std::max(0.0,scrollLines-yoffset*3.0);
+}
+
+// V toggles info and verbose validation messages on top of the
+// default warnings and errors, + and - zoom the text.
+static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods){
+    if(action==GLFW_RELEASE) return;
+    if(key==GLFW_KEY_EQUAL || key==GLFW_KEY_KP_ADD) zoom=std::min(4.0f,zoom*1.25f);
+    if(key==GLFW_KEY_MINUS || key==GLFW_KEY_KP_SUBTRACT) zoom=std::max(0.2f,zoom/1.25f);
+    if(key!=GLFW_KEY_V || action!=GLFW_PRESS) return;
+    ValidationLog& log=ValidationLog::shared();
+    auto chatty=vk::DebugUtilsMessageSeverityFlagBitsEXT::eInfo |
+                vk::DebugUtilsMessageSeverityFlagBitsEXT::eVerbose;
+    log.setSeverities(log.severities() ^ chatty);
+}
 
 std::vector<const char*> instanceExtensions={
     VK_EXT_DEBUG_UTILS_EXTENSION_NAME,
@@ -33,10 +67,11 @@ std::vector<const char*> deviceExtensions={
 static std::vector<char> readFile(const std::string& path){
     std::ifstream file(path,std::ios::binary | std::ios::ate);
     if(!file.is_open()){
-        std::runtime_error(std::format("Failed to open file: {}",errno));
+        throw std::runtime_error(std::format("Failed to open file: {}",path));
     }
 
-    int size=file.tellg();
+    std::streamoff size=file.tellg();
+    if(size<0) throw std::runtime_error(std::format("Failed to read file: {}",path));
     std::vector<char> buffer(size);
     file.seekg(0,std::ios::beg);
     file.read(buffer.data(),size);
@@ -44,99 +79,580 @@ static std::vector<char> readFile(const std::string& path){
     return buffer;
 }
 
+// Maps a pixel-space point into NDC at the current zoom with a small
+// margin.
+static glm::vec2 toNdc(const glm::vec2& p){
+    return glm::vec2(
+        (p.x*zoom+16.0f)/viewport.x*2.0f-1.0f,
+        ((p.y+fontSize)*zoom+16.0f)/viewport.y*2.0f-1.0f
+    );
+}
+
+static std::vector<Vertex> toVertices(const Outline& outline){
+    // The outline pipeline only draws line strips.
+    assert(outline.mode==IndexMode::eLineStrip);
+    std::vector<Vertex> vertices;
+    vertices.reserve(outline.points.size());
+    for(const glm::vec2& p:outline.points){
+        vertices.push_back({toNdc(p),{0.0f,0.0f,0.0f}});
+    }
+    return vertices;
+}
+
+static std::vector<CurveVertex> toVertices(const CurveMesh& mesh){
+    std::vector<CurveVertex> vertices;
+    vertices.reserve(mesh.points.size());
+    for(const CurvePoint& p:mesh.points){
+        vertices.push_back({toNdc(p.pos),p.uv});
+    }
+    return vertices;
+}
 
+// Run bounds go through the same mapping as the vertices so the cull
+// shader can test them against the NDC viewport.
+static std::vector<GpuRun> toGpuRuns(const std::vector<TextRun>& runs){
+    std::vector<GpuRun> gpuRuns;
+    gpuRuns.reserve(runs.size());
+    for(const TextRun& run:runs){
+        glm::vec2 min=toNdc(run.min);
+        glm::vec2 max=toNdc(run.max);
+        gpuRuns.push_back({glm::vec4(min.x,min.y,max.x,max.y),run.firstIndex,run.indexCount,{0,0}});
+    }
+    return gpuRuns;
+}
 
 int main(int argc, char** argv){
+    // --curves evaluates the quadratic outlines on the GPU instead of
+    // drawing the CPU-flattened line strips, --file=<path> streams any
+    // text file instead of the bundled hello.txt, --host-limit-mb=<n>
+    // caps the driver's host memory and --no-cull draws every laid out
+    // line directly instead of culling runs on the GPU.
+    // --pacing=throughput|low-latency|power-saving picks the frame
+    // pacing, --target-fps=<n> sets the power-saving frame rate and
+    // --glyph-cache-mb=<n> caps the flattened glyph cache. --watch
+    // reloads the shaders and the font when they change on disk and
+    // --gpu-budget-mb=<n> caps the device memory used on each heap.
+    bool curveMode=false;
+    bool cullEnabled=true;
+    bool watch=false;
+    PacingMode pacingMode=PacingMode::eThroughput;
+    double targetFps=30.0;
+    std::string textArg;
+    uint64_t hostLimit=0;
+    uint64_t gpuBudget=0;
+    size_t glyphCacheLimit=16<<20;
+    for(int i=1;i<argc;i++){
+        std::string arg=argv[i];
+        if(arg=="--curves") curveMode=true;
+        else if(arg=="--no-cull") cullEnabled=false;
+        else if(arg=="--watch") watch=true;
+        else if(arg.starts_with("--pacing=")) pacingMode=FramePacer::parseMode(arg.substr(9));
+        else if(arg.starts_with("--target-fps=")) targetFps=std::stod(arg.substr(13));
+        else if(arg.starts_with("--file=")) textArg=arg.substr(7);
+        else if(arg.starts_with("--host-limit-mb=")) hostLimit=std::stoull(arg.substr(16))<<20;
+        else if(arg.starts_with("--gpu-budget-mb=")) gpuBudget=std::stoull(arg.substr(16))<<20;
+        else if(arg.starts_with("--glyph-cache-mb=")) glyphCacheLimit=std::stoull(arg.substr(17))<<20;
+    }
     std::string error;
     std::unique_ptr<Runfiles> runfiles(Runfiles::Create(argv[0], &error));
-    std::string vertPath = runfiles->Rlocation("_main/example_bin/data/shaders/vert.spv");
-    std::string fragPath = runfiles->Rlocation("_main/example_bin/data/shaders/frag.spv");
+    std::string vertPath = runfiles->Rlocation(curveMode?
+        "_main/example_bin/data/shaders/curve_vert.spv":
+        "_main/example_bin/data/shaders/vert.spv");
+    std::string fragPath = runfiles->Rlocation(curveMode?
+        "_main/example_bin/data/shaders/curve_frag.spv":
+        "_main/example_bin/data/shaders/frag.spv");
+    std::string cullPath = runfiles->Rlocation("_main/example_bin/data/shaders/cull_comp.spv");
+    std::string vertSource = runfiles->Rlocation(curveMode?
+        "_main/example_bin/data/shaders/curve.vert":
+        "_main/example_bin/data/shaders/shader.vert");
+    std::string fragSource = runfiles->Rlocation(curveMode?
+        "_main/example_bin/data/shaders/curve.frag":
+        "_main/example_bin/data/shaders/shader.frag");
+    std::string cullSource = runfiles->Rlocation("_main/example_bin/data/shaders/cull.comp");
     std::string fontPath = runfiles->Rlocation("_main/example_bin/data/Roboto-Black.ttf");
-    GLFWwindow* handle=vo::create::window(600,500,"Vulkan");
-    vk::raii::Context context{};
-    vk::raii::Instance instance=vo::create::instance(
-        context,
-        "Vulkan",
-        "No engine",
-        instanceLayers,
-        instanceExtensions
-    );
-    vk::raii::PhysicalDevice physicalDevice = vo::create::physicalDevice(instance);
-    QueueFamily family=vo::utils::findQueueFamily(physicalDevice);
-    vk::raii::Device device=vo::create::logicalDevice(
-        physicalDevice, family, {}, deviceExtensions
-    );
-    vk::raii::Queue graphicsQueue=vo::create::queue(device, family);
-    vk::raii::SurfaceKHR surface=vo::create::surface(instance, handle);
-    SwapchainInfo swapchainInfo=vo::utils::querySwapChainInfo(
-        physicalDevice,
-        device,
-        surface,
-        handle
-    );
-    ImageInfo imageInfo={
-        swapchainInfo.surfaceFormat.format,
-        swapchainInfo.extent.width,
-        swapchainInfo.extent.height
+    std::string textPath = textArg.empty()?
+        runfiles->Rlocation("_main/example_bin/data/hello.txt"):
+        textArg;
+
+    // Startup runs as a dependency graph: file reads and font loading
+    // start before the instance exists and the pipeline is compiled
+    // while the swapchain and framebuffers are created.
+    FT_Library library=nullptr;
+    FT_Face face=nullptr;
+    std::unique_ptr<TextView> textView;
+    GlyphCache glyphCache(glyphCacheLimit);
+    float lineHeight=0.0f;
+    uint32_t visibleLines=0;
+    std::vector<char> vertexCode;
+    std::vector<char> fragmentCode;
+    std::vector<char> cullCode;
+    GLFWwindow* handle=nullptr;
+    // Declared before every Vulkan object so it outlives all of them.
+    HostAllocator hostAllocator(hostLimit);
+    const vk::AllocationCallbacks* hostCallbacks=&hostAllocator.callbacks();
+    std::optional<vk::raii::Context> context;
+    vk::raii::Instance instance{nullptr};
+    vk::raii::DebugUtilsMessengerEXT messenger{nullptr};
+    vk::raii::PhysicalDevice physicalDevice{nullptr};
+    // Outlives every buffer charged to it.
+    std::optional<ResidencyManager> residency;
+    QueueFamily family{};
+    vk::raii::Device device{nullptr};
+    vk::raii::Queue graphicsQueue{nullptr};
+    vk::raii::SurfaceKHR surface{nullptr};
+    SwapchainResources swapchain{SwapchainInfo{nullptr}};
+    vk::raii::ShaderModule vertexShaderModule{nullptr};
+    vk::raii::ShaderModule fragmentShaderModule{nullptr};
+    vk::raii::RenderPass renderpass{nullptr};
+    vk::raii::PipelineLayout layout{nullptr};
+    vk::raii::Pipeline pipeline{nullptr};
+    vk::raii::CommandPool pool{nullptr};
+    vk::raii::CommandBuffer commandbuffer{nullptr};
+    vk::raii::DescriptorSetLayout cullSetLayout{nullptr};
+    vk::raii::PipelineLayout cullLayout{nullptr};
+    vk::raii::ShaderModule cullShaderModule{nullptr};
+    vk::raii::Pipeline cullPipeline{nullptr};
+    vk::raii::DescriptorPool descriptorPool{nullptr};
+    bool drawCount=false;
+    bool multiDraw=false;
+    FrameSync sync{nullptr,nullptr,nullptr};
+    RetireQueue retired;
+
+    // Laid out windows stay on the GPU as residents of the residency
+    // manager, so scrolling or zooming back to one skips layout and
+    // upload. The window on screen is not a resident and cannot be
+    // evicted; generation moves on when the text or font changes.
+    struct WindowMesh{
+        MeshBuffers mesh{nullptr,nullptr,nullptr,nullptr,0};
+        CullBuffers cull{nullptr,nullptr,nullptr,nullptr,nullptr,0};
+        // False while the background index had not reached the end of
+        // the window yet.
+        bool complete=false;
+        uint64_t resident=0;
+        uint64_t lastFrame=0;
     };
-    std::vector<vk::Image> images=vo::create::images(swapchainInfo.swapchain);
-    std::vector<vk::raii::ImageView> imageViews=vo::create::imageViews(
-        device,images,swapchainInfo.surfaceFormat.format
-    );
+    using WindowKey=std::tuple<uint64_t,float,uint64_t>;
+    // Each window holds a descriptor set, this leaves room in the pool
+    // for the one on screen and those waiting in retired.
+    const size_t maxCachedWindows=32;
+    std::map<WindowKey,std::shared_ptr<WindowMesh>> windows;
+    std::shared_ptr<WindowMesh> current=std::make_shared<WindowMesh>();
+    WindowKey currentKey{};
+    uint64_t generation=0;
 
-    vk::raii::Buffer vertexBuffer=vo::create::vertexbuffer(device, vertices);
-    vk::MemoryRequirements memRequirements=vertexBuffer.getMemoryRequirements();
-        uint32_t memType=vo::utils::findMemoryType(
-            physicalDevice,
-            memRequirements.memoryTypeBits,
-            vk::MemoryPropertyFlagBits::eHostVisible |
-            vk::MemoryPropertyFlagBits::eHostCoherent
+    // Lays out only the lines around the viewport and uploads them,
+    // the window is shifted up so that firstLine lands at the top.
+    // Line strips come from the glyph cache at the detail level for
+    // the current zoom.
+    auto buildWindow=[&](uint64_t firstLine){
+        auto window=std::make_shared<WindowMesh>();
+        uint64_t windowFirst;
+        std::string text=textView->window(firstLine,visibleLines,prefetchLines,windowFirst);
+        window->complete=textView->indexed() ||
+                         textView->lineCount()>=firstLine+visibleLines+prefetchLines;
+        float shift=(static_cast<float>(windowFirst)-static_cast<float>(firstLine))*lineHeight;
+        std::vector<TextRun> runs;
+        if(curveMode){
+            CurveMesh curves=ps::utils::curves(face,text);
+            for(CurvePoint& p:curves.points) p.pos.y+=shift;
+            if(!curves.indices.empty()){
+                window->mesh=vo::create::meshBuffers(
+                    physicalDevice,device,toVertices(curves),curves.indices,hostCallbacks,&*residency
+                );
+            }
+            runs=std::move(curves.runs);
+        }else{
+            Outline outline=ps::utils::outline(face,text,glyphCache,fontSize*zoom);
+            for(glm::vec2& p:outline.points) p.y+=shift;
+            if(!outline.indices.empty()){
+                window->mesh=vo::create::meshBuffers(
+                    physicalDevice,device,toVertices(outline),outline.indices,hostCallbacks,&*residency
+                );
+            }
+            runs=std::move(outline.runs);
+        }
+        // The prefetched lines are in the mesh but off screen, the cull
+        // pass drops them along with anything else outside the viewport.
+        if(cullEnabled && !runs.empty()){
+            for(TextRun& run:runs){
+                run.min.y+=shift;
+                run.max.y+=shift;
+            }
+            window->cull=vo::create::cullBuffers(
+                physicalDevice,device,descriptorPool,cullSetLayout,
+                toGpuRuns(runs),hostCallbacks,&*residency
+            );
+        }
+        return window;
+    };
+    // Frames up to sync.completed are done with a window, anything used
+    // later waits in retired.
+    auto dropWindow=[&](std::shared_ptr<WindowMesh> window){
+        if(window->lastFrame>sync.completed) retired.retire(sync.submitted,std::move(window));
+    };
+    // The window leaving the screen becomes a resident, the evicted
+    // one is dropped at once when the GPU is done with it.
+    auto parkCurrent=[&]{
+        current->lastFrame=sync.submitted;
+        auto it=windows.find(currentKey);
+        if(it==windows.end() || it->second!=current){
+            dropWindow(std::move(current));
+            return;
+        }
+        WindowKey key=currentKey;
+        current->resident=residency->addResident(
+            {&current->mesh.charge,&current->cull.charge},
+            [&windows,&dropWindow,key]{
+                auto evicted=windows.find(key);
+                if(evicted==windows.end()) return;
+                std::shared_ptr<WindowMesh> window=std::move(evicted->second);
+                windows.erase(evicted);
+                dropWindow(std::move(window));
+            }
         );
+    };
+    // Font or text changes invalidate every cached window.
+    auto dropWindows=[&]{
+        generation++;
+        for(auto& [key,window]:windows){
+            residency->removeResident(window->resident);
+            if(window!=current) dropWindow(std::move(window));
+        }
+        windows.clear();
+    };
+    uint64_t knownLines=0;
+    float builtZoom=zoom;
+    auto showWindow=[&](uint64_t firstLine){
+        knownLines=textView->lineCount();
+        builtZoom=zoom;
+        visibleLines=static_cast<uint32_t>(viewport.y/(lineHeight*zoom))+1;
+        parkCurrent();
 
-    vk::raii::DeviceMemory memory=vo::utils::allocateBuffer(device,memRequirements,memType);
-    vo::utils::fillBuffer(vertexBuffer,memory,memRequirements,vertices);
-
-    auto vertexCode=readFile(vertPath);
-    auto fragmentCode=readFile(fragPath);
-    vk::raii::ShaderModule vertexShaderModule=vo::create::shaderModule(device,vertexCode);
-    vk::raii::ShaderModule fragmentShaderModule=vo::create::shaderModule(device,fragmentCode);
-    vk::raii::RenderPass renderpass=vo::create::renderpass(device,imageInfo);
-    vk::raii::PipelineLayout layout=vo::create::layout(device);
-    vk::raii::Pipeline pipeline=vo::create::pipeline(
-        device, vertexShaderModule,fragmentShaderModule, renderpass, 
-        layout,swapchainInfo
-    );
-    std::vector<vk::raii::Framebuffer> framebuffers=vo::create::framebuffers(
-        device,
-        renderpass,
-        imageViews,
-        imageInfo
-    );
-    vk::raii::CommandPool pool=vo::create::commandpool(device,family);
-    vk::raii::CommandBuffer commandbuffer=vo::create::commandbuffer(device,pool);
+        WindowKey key{firstLine,zoom,generation};
+        auto it=windows.find(key);
+        if(it!=windows.end() && !it->second->complete){
+            residency->removeResident(it->second->resident);
+            dropWindow(std::move(it->second));
+            windows.erase(it);
+            it=windows.end();
+        }
+        if(it!=windows.end()){
+            current=it->second;
+            residency->removeResident(current->resident);
+            current->resident=0;
+        }else{
+            // Over budget with nothing left to evict, the window stays
+            // blank until it is laid out again.
+            try{
+                current=buildWindow(firstLine);
+                windows[key]=current;
+            }catch(const std::runtime_error& e){
+                std::cerr<<"Failed to upload lines: "<<e.what()<<"\n";
+                current=std::make_shared<WindowMesh>();
+            }
+        }
+        currentKey=key;
+        while(windows.size()>maxCachedWindows && residency->evictOldest()){}
+    };
+    uint64_t firstLine=0;
 
-    vk::raii::Semaphore imageAcquiredSemaphore(device,vk::SemaphoreCreateInfo());
-    vk::raii::Semaphore renderFinishedSemaphore(device,vk::SemaphoreCreateInfo());
-    vk::raii::Fence fence(device,vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
+    js::Graph startup;
+    auto fontStep=startup.add("font",[&]{
+        library=ps::create::library();
+        face=ps::create::face(library,fontPath,fontSize);
+        textView=std::make_unique<TextView>(textPath);
+        lineHeight=face->size->metrics.height/64.0f;
+        visibleLines=static_cast<uint32_t>(windowHeight/lineHeight)+1;
+    });
+    auto shaderFileStep=startup.add("shader files",[&]{
+        vertexCode=readFile(vertPath);
+        fragmentCode=readFile(fragPath);
+        // Without the cull shader every laid out line is drawn directly.
+        if(!cullEnabled) return;
+        try{
+            cullCode=readFile(cullPath);
+        }catch(const std::runtime_error& e){
+            std::cerr<<e.what()<<", drawing without culling\n";
+            cullEnabled=false;
+        }
+    });
+    // GLFW has to be initialised on the main thread.
+    auto windowStep=startup.add("window",[&]{
+        handle=vo::create::window(windowWidth,windowHeight,"Vulkan");
+        glfwSetScrollCallback(handle,scrollCallback);
+        glfwSetKeyCallback(handle,keyCallback);
+    },{},js::Affinity::eMain);
+    auto instanceStep=startup.add("instance",[&]{
+        context.emplace();
+        instance=vo::create::instance(
+            *context,
+            "Vulkan",
+            "No engine",
+            instanceLayers,
+            instanceExtensions,
+            hostCallbacks
+        );
+#ifndef NDEBUG
+        messenger=vo::create::debugMessenger(instance,hostCallbacks);
+#endif
+    });
+    auto deviceStep=startup.add("device",[&]{
+        physicalDevice=vo::create::physicalDevice(instance);
+        family=vo::utils::findQueueFamily(physicalDevice);
+        drawCount=vo::utils::hasDeviceExtension(physicalDevice,VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        if(drawCount) deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        multiDraw=physicalDevice.getFeatures().multiDrawIndirect;
+        bool memoryBudget=vo::utils::hasDeviceExtension(physicalDevice,VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if(memoryBudget) deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        residency.emplace(physicalDevice,vo::utils::instanceVersion(*context),memoryBudget,gpuBudget);
+        // Evicted windows wait in retired for the frame that used them,
+        // on out of memory that frame is waited for and they are freed.
+        residency->setReclaim([&]{
+            if(retired.size()==0) return false;
+            vo::utils::waitForFrame(device,sync);
+            retired.collect(sync.completed);
+            return true;
+        });
+        device=vo::create::logicalDevice(
+            physicalDevice, family, {}, deviceExtensions, hostCallbacks
+        );
+        graphicsQueue=vo::create::queue(device, family);
+    },{instanceStep});
+    auto surfaceStep=startup.add("surface",[&]{
+        surface=vo::create::surface(instance, handle, hostCallbacks);
+    },{instanceStep,windowStep});
+    // Reads the framebuffer size, which GLFW only allows on the main
+    // thread.
+    auto swapchainStep=startup.add("swapchain",[&]{
+        swapchain.info=vo::utils::querySwapChainInfo(
+            physicalDevice,
+            device,
+            surface,
+            handle,
+            vo::utils::pickPresentMode(physicalDevice,surface,FramePacer::presentModes(pacingMode)),
+            nullptr,
+            hostCallbacks
+        );
+        swapchain.images=vo::create::images(swapchain.info.swapchain);
+        swapchain.views=vo::create::imageViews(
+            device,swapchain.images,swapchain.info.surfaceFormat.format,hostCallbacks
+        );
+        viewport=glm::vec2(swapchain.info.extent.width,swapchain.info.extent.height);
+    },{deviceStep,surfaceStep},js::Affinity::eMain);
+    auto renderpassStep=startup.add("render pass",[&]{
+        ImageInfo formatInfo{vo::utils::pickSurfaceFormat(physicalDevice,surface).format,0,0};
+        renderpass=vo::create::renderpass(device,formatInfo,hostCallbacks);
+    },{deviceStep,surfaceStep});
+    auto shaderModuleStep=startup.add("shader modules",[&]{
+        vertexShaderModule=vo::create::shaderModule(device,vertexCode,hostCallbacks);
+        fragmentShaderModule=vo::create::shaderModule(device,fragmentCode,hostCallbacks);
+    },{deviceStep,shaderFileStep});
+    auto makePipeline=[&]{
+        return curveMode?
+            vo::create::curvePipeline(
+                device, vertexShaderModule,fragmentShaderModule, renderpass,
+                layout, hostCallbacks
+            ):
+            vo::create::pipeline(
+                device, vertexShaderModule,fragmentShaderModule, renderpass,
+                layout, hostCallbacks
+            );
+    };
+    startup.add("pipeline",[&]{
+        layout=vo::create::layout(device,hostCallbacks);
+        pipeline=makePipeline();
+    },{renderpassStep,shaderModuleStep});
+    startup.add("framebuffers",[&]{
+        ImageInfo imageInfo={
+            swapchain.info.surfaceFormat.format,
+            swapchain.info.extent.width,
+            swapchain.info.extent.height
+        };
+        swapchain.framebuffers=vo::create::framebuffers(
+            device,
+            renderpass,
+            swapchain.views,
+            imageInfo,
+            hostCallbacks
+        );
+    },{swapchainStep,renderpassStep});
+    auto cullStep=startup.add("cull pipeline",[&]{
+        if(!cullEnabled) return;
+        // One set per live mesh plus the ones still waiting in retired.
+        descriptorPool=vo::create::descriptorPool(device,64,hostCallbacks);
+        cullSetLayout=vo::create::cullSetLayout(device,hostCallbacks);
+        cullLayout=vo::create::cullLayout(device,cullSetLayout,hostCallbacks);
+        cullShaderModule=vo::create::shaderModule(device,cullCode,hostCallbacks);
+        cullPipeline=vo::create::cullPipeline(device,cullShaderModule,cullLayout,hostCallbacks);
+    },{deviceStep,shaderFileStep});
+    // Vertices are laid out for the swapchain's extent.
+    startup.add("mesh",[&]{
+        showWindow(firstLine);
+    },{deviceStep,fontStep,cullStep,swapchainStep});
+    startup.add("commands",[&]{
+        pool=vo::create::commandpool(device,family,hostCallbacks);
+        commandbuffer=vo::create::commandbuffer(device,pool);
+        sync.imageAcquired=vk::raii::Semaphore(device,vk::SemaphoreCreateInfo(),hostCallbacks);
+        sync.renderFinished=vk::raii::Semaphore(device,vk::SemaphoreCreateInfo(),hostCallbacks);
+        sync.inFlight=vk::raii::Fence(device,vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled),hostCallbacks);
+    },{deviceStep});
+    startup.run();
+    startup.printTrace(std::cout);
 
+    std::unique_ptr<FileWatcher> watcher;
+    std::unique_ptr<ShaderCompiler> shaderCompiler;
+    if(watch){
+        std::vector<std::string> watched={vertSource,fragSource,fontPath};
+        if(cullEnabled) watched.push_back(cullSource);
+        watcher=std::make_unique<FileWatcher>(watched);
+        shaderCompiler=std::make_unique<ShaderCompiler>();
+        std::cout<<"watching "<<watched.size()<<" files"<<(watcher->native()?"":" by polling")<<"\n";
+    }
+    // Only the pipeline built from the changed module is recreated, the
+    // one it replaces is retired until the frames using it complete.
+    auto reloadShader=[&](const CompiledShader& shader){
+        vk::raii::ShaderModule module=vo::create::shaderModule(device,shader.code,hostCallbacks);
+        if(shader.source==cullSource){
+            vk::raii::Pipeline rebuilt=vo::create::cullPipeline(device,module,cullLayout,hostCallbacks);
+            cullShaderModule=std::move(module);
+            retired.retire(sync.submitted,std::move(cullPipeline));
+            cullPipeline=std::move(rebuilt);
+            return;
+        }
+        vk::raii::ShaderModule& slot=shader.source==vertSource?vertexShaderModule:fragmentShaderModule;
+        std::swap(slot,module);
+        try{
+            vk::raii::Pipeline rebuilt=makePipeline();
+            retired.retire(sync.submitted,std::move(pipeline));
+            pipeline=std::move(rebuilt);
+        }catch(...){
+            std::swap(slot,module);
+            throw;
+        }
+    };
+    // The glyph cache only holds this face, so all of it goes.
+    auto reloadFont=[&]{
+        FT_Face reloaded=ps::create::face(library,fontPath,fontSize);
+        FT_Done_Face(face);
+        face=reloaded;
+        lineHeight=face->size->metrics.height/64.0f;
+        glyphCache.clear();
+    };
+
+    const GLFWvidmode* videoMode=glfwGetVideoMode(glfwGetPrimaryMonitor());
+    FramePacer pacer(pacingMode,videoMode?videoMode->refreshRate:0.0,targetFps);
+    std::cout<<"present mode "<<vk::to_string(swapchain.info.presentMode)<<"\n";
 
     while(!glfwWindowShouldClose(handle)){
+        pacer.waitForFrame();
+        // Input is latched only once the GPU can take the frame, so
+        // waiting on the fence does not count towards its latency.
+        vo::utils::waitForFrame(device,sync);
         glfwPollEvents();
+        pacer.inputPolled();
+        uint64_t lineCount=textView->lineCount();
+        uint64_t scrolledLine=std::min<uint64_t>(
+            static_cast<uint64_t>(scrollLines),
+            lineCount>0?lineCount-1:0
+        );
+        // Also re-layout while the background index is still growing
+        // into the visible window.
+        bool windowGrew=lineCount!=knownLines &&
+                        knownLines<firstLine+visibleLines+prefetchLines;
+        bool fontChanged=false;
+        if(watcher){
+            for(const std::string& path:watcher->poll()){
+                if(path!=fontPath){
+                    shaderCompiler->compile(path);
+                    continue;
+                }
+                // A half-written font fails to load, the next save
+                // triggers another attempt.
+                try{
+                    reloadFont();
+                    fontChanged=true;
+                    std::cout<<"reloaded "<<path<<"\n";
+                }catch(const std::exception& e){
+                    std::cerr<<"Keeping the old font: "<<e.what()<<"\n";
+                }
+            }
+            for(const CompiledShader& shader:shaderCompiler->poll()){
+                if(!shader.ok){
+                    std::cerr<<shader.log;
+                    continue;
+                }
+                try{
+                    reloadShader(shader);
+                    std::cout<<"reloaded "<<shader.source<<"\n";
+                }catch(const std::exception& e){
+                    std::cerr<<"Keeping the old pipeline: "<<e.what()<<"\n";
+                }
+            }
+        }
+        if(windowGrew || fontChanged) dropWindows();
+        if(scrolledLine!=firstLine || windowGrew || zoom!=builtZoom || fontChanged){
+            firstLine=scrolledLine;
+            showWindow(firstLine);
+        }
+        CullPass cullPass{
+            cullPipeline,cullLayout,current->cull,
+            glm::vec4(-1.0f,-1.0f,1.0f,1.0f),
+            drawCount,multiDraw
+        };
         auto [waitRes,presentRes]=vo::utils::drawFrame(
             device,
-            swapchainInfo,
+            swapchain.info,
             renderpass,
             pipeline,
             commandbuffer,
-            imageAcquiredSemaphore,
-            renderFinishedSemaphore,
-            fence,
-            framebuffers,
+            sync,
+            swapchain.framebuffers,
             graphicsQueue,
-            vertexBuffer,
-            vertices
+            current->mesh.vertexbuffer,
+            current->mesh.indexbuffer,
+            current->mesh.indexCount,
+            cullEnabled?&cullPass:nullptr
         );
-        device.waitIdle();
+        if(waitRes==vk::Result::eSuccess || waitRes==vk::Result::eSuboptimalKHR){
+            pacer.presented();
+        }
+        retired.collect(sync.completed);
+        residency->trim();
+
+        bool outOfDate=waitRes==vk::Result::eErrorOutOfDateKHR ||
+                       presentRes==vk::Result::eErrorOutOfDateKHR ||
+                       presentRes==vk::Result::eSuboptimalKHR;
+        if(outOfDate || framebufferResized){
+            framebufferResized=false;
+            // A minimised window has a zero extent, nothing can be
+            // presented until it is restored.
+            int width=0,height=0;
+            glfwGetFramebufferSize(handle,&width,&height);
+            while((width==0 || height==0) && !glfwWindowShouldClose(handle)){
+                glfwWaitEvents();
+                glfwGetFramebufferSize(handle,&width,&height);
+            }
+            if(glfwWindowShouldClose(handle)) break;
+            SwapchainResources resized=vo::utils::recreateSwapchain(
+                physicalDevice,device,surface,handle,renderpass,swapchain,hostCallbacks
+            );
+            retired.retire(sync.submitted,std::move(swapchain));
+            swapchain=std::move(resized);
+            // Vertices are in NDC, a new extent needs a new layout.
+            glm::vec2 extent(swapchain.info.extent.width,swapchain.info.extent.height);
+            if(extent!=viewport){
+                viewport=extent;
+                dropWindows();
+                showWindow(firstLine);
+            }
+        }
     }
+    device.waitIdle();
+    pacer.report(std::cout);
+    hostAllocator.report(std::cout);
+    if(!curveMode) glyphCache.report(std::cout);
+    residency->report(std::cout);
 
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "graph.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+
+namespace js{
+    Graph::Step Graph::add(
+        const std::string& name,
+        std::function<void()> fn,
+        std::initializer_list<Step> dependencies,
+        Affinity affinity
+    ){
+        Step step=static_cast<Step>(nodes.size());
+        Node& node=nodes.emplace_back();
+        node.name=name;
+        node.fn=std::move(fn);
+        node.affinity=affinity;
+        for(Step dependency:dependencies){
+            if(dependency>=step) throw std::runtime_error("Step depends on a later step: "+name);
+            nodes[dependency].dependents.push_back(step);
+            node.dependencies++;
+        }
+        return step;
+    }
+
+    void Graph::run(Scheduler& pool){
+        scheduler=&pool;
+        steps.assign(nodes.size(),StepTrace{});
+        outstanding=static_cast<uint32_t>(nodes.size());
+        error=nullptr;
+        start=std::chrono::steady_clock::now();
+
+        for(Node& node:nodes){
+            node.remaining=node.dependencies;
+            node.skip=false;
+        }
+        for(Step step=0;step<nodes.size();step++){
+            if(nodes[step].dependencies==0) ready(step);
+        }
+
+        std::unique_lock<std::mutex> lock(mainMutex);
+        while(true){
+            mainWake.wait(lock,[this]{ return outstanding==0 || !mainQueue.empty(); });
+            if(mainQueue.empty()) break;
+            Step step=mainQueue.front();
+            mainQueue.pop_front();
+            lock.unlock();
+            execute(step);
+            lock.lock();
+        }
+        totalMs=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+        if(error) std::rethrow_exception(error);
+    }
+
+    void Graph::ready(Step step){
+        if(nodes[step].affinity==Affinity::eMain){
+            {
+                std::lock_guard<std::mutex> lock(mainMutex);
+                mainQueue.push_back(step);
+            }
+            mainWake.notify_one();
+            return;
+        }
+        scheduler->submit([this,step]{ execute(step); });
+    }
+
+    void Graph::execute(Step step){
+        Node& node=nodes[step];
+        auto begin=std::chrono::steady_clock::now();
+        bool failed=node.skip.load();
+        if(!failed){
+            try{
+                node.fn();
+            }catch(...){
+                failed=true;
+                std::lock_guard<std::mutex> lock(mainMutex);
+                if(!error) error=std::current_exception();
+            }
+        }
+        auto end=std::chrono::steady_clock::now();
+        steps[step]=StepTrace{
+            node.name,
+            std::chrono::duration<double,std::milli>(begin-start).count(),
+            std::chrono::duration<double,std::milli>(end-begin).count(),
+            node.affinity==Affinity::eMain
+        };
+
+        for(Step dependent:node.dependents){
+            if(failed) nodes[dependent].skip=true;
+            if(nodes[dependent].remaining.fetch_sub(1)==1) ready(dependent);
+        }
+        // Notified under the lock: once run() sees zero it may return
+        // and destroy the graph.
+        std::lock_guard<std::mutex> lock(mainMutex);
+        if(--outstanding==0) mainWake.notify_one();
+    }
+
+    const std::vector<StepTrace>& Graph::trace() const{
+        return steps;
+    }
+
+    void Graph::printTrace(std::ostream& out) const{
+        std::vector<StepTrace> sorted=steps;
+        std::sort(sorted.begin(),sorted.end(),[](const StepTrace& a,const StepTrace& b){
+            return a.startMs<b.startMs;
+        });
+        out<<"startup: "<<std::fixed<<std::setprecision(2)<<totalMs<<" ms\n";
+        for(const StepTrace& step:sorted){
+            out<<"  "<<std::left<<std::setw(16)<<step.name<<std::right
+               <<std::setw(9)<<step.startMs<<" ms +"
+               <<std::setw(8)<<step.durationMs<<" ms"
+               <<(step.mainThread?"  [main]":"")<<"\n";
+        }
+    }
+}
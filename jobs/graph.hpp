@@ -0,0 +1,70 @@
+#pragma once
+#include "jobs.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <initializer_list>
+#include <iosfwd>
+#include <string>
+
+namespace js{
+    enum class Affinity{
+        eAny,
+        // For APIs such as glfwInit that must run on the thread that
+        // calls Graph::run.
+        eMain
+    };
+
+    struct StepTrace{
+        std::string name;
+        double startMs;
+        double durationMs;
+        bool mainThread;
+    };
+
+    // Dependency graph of one-shot steps, each step is started as soon
+    // as everything it depends on has finished.
+    class Graph{
+    public:
+        using Step=uint32_t;
+
+        Step add(
+            const std::string& name,
+            std::function<void()> fn,
+            std::initializer_list<Step> dependencies={},
+            Affinity affinity=Affinity::eAny
+        );
+        // Blocks until every step ran, rethrows the first failure. Steps
+        // that depend on a failed step are skipped.
+        void run(Scheduler& scheduler=Scheduler::shared());
+
+        const std::vector<StepTrace>& trace() const;
+        void printTrace(std::ostream& out) const;
+
+    private:
+        struct Node{
+            std::string name;
+            std::function<void()> fn;
+            Affinity affinity;
+            std::vector<Step> dependents;
+            uint32_t dependencies=0;
+            std::atomic<uint32_t> remaining{0};
+            std::atomic<bool> skip{false};
+        };
+
+        void ready(Step step);
+        void execute(Step step);
+
+        std::deque<Node> nodes;
+        std::vector<StepTrace> steps;
+        Scheduler* scheduler=nullptr;
+        std::chrono::steady_clock::time_point start;
+        double totalMs=0.0;
+
+        std::mutex mainMutex;
+        std::condition_variable mainWake;
+        std::deque<Step> mainQueue;
+        uint32_t outstanding=0;
+        std::exception_ptr error;
+    };
+};
@@ -0,0 +1,195 @@
+#include "jobs.hpp"
+#include <algorithm>
+
+namespace{
+    // Index of the worker running on this thread, -1 on threads that
+    // do not belong to a scheduler.
+    thread_local int32_t currentWorker=-1;
+    thread_local const js::Scheduler* currentScheduler=nullptr;
+}
+
+namespace js{
+    Scheduler::Scheduler(uint32_t workerCount){
+        workerCount=std::max(1u,workerCount);
+        workers.reserve(workerCount);
+        for(uint32_t i=0;i<workerCount;i++){
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for(uint32_t i=0;i<workerCount;i++){
+            workers[i]->thread=std::thread(&Scheduler::workerLoop,this,i);
+        }
+    }
+
+    Scheduler::~Scheduler(){
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running=false;
+        }
+        wake.notify_all();
+        for(auto& worker:workers){
+            worker->thread.join();
+        }
+    }
+
+    Scheduler& Scheduler::shared(){
+        static Scheduler scheduler;
+        return scheduler;
+    }
+
+    uint32_t Scheduler::workerCount() const{
+        return static_cast<uint32_t>(workers.size());
+    }
+
+    TaskHandle Scheduler::submit(
+        std::function<void()> fn,
+        const TaskHandle& parent
+    ){
+        auto task=std::make_shared<Task>();
+        task->fn=std::move(fn);
+        task->parent=parent;
+        if(parent) parent->pending.fetch_add(1,std::memory_order_relaxed);
+        push(task);
+        return task;
+    }
+
+    void Scheduler::wait(const TaskHandle& task){
+        int32_t self=currentScheduler==this?currentWorker:-1;
+        while(task->pending.load(std::memory_order_acquire)>0){
+            if(TaskHandle next=pop(self)){
+                execute(next);
+                continue;
+            }
+            // The rest of task runs on other threads, sleep until
+            // something completes or more work shows up.
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            waiters.fetch_add(1);
+            finished.wait(lock,[&]{
+                return task->pending.load()==0 || queued.load(std::memory_order_acquire)>0;
+            });
+            waiters.fetch_sub(1);
+        }
+        if(task->error) std::rethrow_exception(task->error);
+    }
+
+    TaskHandle Scheduler::group(){
+        return std::make_shared<Task>();
+    }
+
+    // The group's own count is released only here, so it cannot
+    // complete while children are still being submitted.
+    void Scheduler::seal(const TaskHandle& group){
+        finish(group);
+    }
+
+    void Scheduler::parallelFor(
+        size_t begin,
+        size_t end,
+        size_t grain,
+        const std::function<void(size_t,size_t)>& fn
+    ){
+        if(begin>=end) return;
+        grain=std::max<size_t>(1,grain);
+        if(end-begin<=grain){
+            fn(begin,end);
+            return;
+        }
+        TaskHandle root=group();
+        for(size_t first=begin;first<end;first+=grain){
+            size_t last=std::min(end,first+grain);
+            submit([&fn,first,last]{ fn(first,last); },root);
+        }
+        seal(root);
+        wait(root);
+    }
+
+    void Scheduler::push(TaskHandle task){
+        uint32_t index;
+        if(currentScheduler==this && currentWorker>=0){
+            index=static_cast<uint32_t>(currentWorker);
+        }else{
+            index=nextWorker.fetch_add(1,std::memory_order_relaxed)%workers.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->tasks.push_back(std::move(task));
+        }
+        queued.fetch_add(1,std::memory_order_release);
+        bool waiting;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            waiting=waiters.load()>0;
+        }
+        wake.notify_one();
+        if(waiting) finished.notify_all();
+    }
+
+    TaskHandle Scheduler::pop(int32_t self){
+        if(self>=0){
+            Worker& own=*workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if(!own.tasks.empty()){
+                TaskHandle task=std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued.fetch_sub(1,std::memory_order_relaxed);
+                return task;
+            }
+        }
+        uint32_t count=static_cast<uint32_t>(workers.size());
+        uint32_t start=self>=0?static_cast<uint32_t>(self)+1:nextWorker.load(std::memory_order_relaxed);
+        for(uint32_t i=0;i<count;i++){
+            uint32_t victim=(start+i)%count;
+            if(static_cast<int32_t>(victim)==self) continue;
+            Worker& other=*workers[victim];
+            std::unique_lock<std::mutex> lock(other.mutex,std::try_to_lock);
+            if(!lock.owns_lock() || other.tasks.empty()) continue;
+            TaskHandle task=std::move(other.tasks.front());
+            other.tasks.pop_front();
+            queued.fetch_sub(1,std::memory_order_relaxed);
+            return task;
+        }
+        return nullptr;
+    }
+
+    void Scheduler::execute(const TaskHandle& task){
+        try{
+            if(task->fn) task->fn();
+        }catch(...){
+            std::lock_guard<std::mutex> lock(task->errorMutex);
+            if(!task->error) task->error=std::current_exception();
+        }
+        finish(task);
+    }
+
+    void Scheduler::finish(const TaskHandle& task){
+        if(task->pending.fetch_sub(1)!=1) return;
+        // Pairs with the waiter counting itself before it checks pending.
+        if(waiters.load()>0){
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            finished.notify_all();
+        }
+        if(!task->parent) return;
+        if(task->error){
+            std::lock_guard<std::mutex> lock(task->parent->errorMutex);
+            if(!task->parent->error) task->parent->error=task->error;
+        }
+        finish(task->parent);
+    }
+
+    void Scheduler::workerLoop(uint32_t index){
+        currentWorker=static_cast<int32_t>(index);
+        currentScheduler=this;
+        while(true){
+            if(TaskHandle task=pop(currentWorker)){
+                execute(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock,[this]{
+                return !running || queued.load(std::memory_order_acquire)>0;
+            });
+            if(!running) return;
+        }
+    }
+}
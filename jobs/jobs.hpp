@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace js{
+    // A unit of work. pending counts the task itself plus every child
+    // that has not finished yet, the task completes when it drops to zero.
+    struct Task{
+        std::function<void()> fn;
+        std::shared_ptr<Task> parent;
+        std::atomic<uint32_t> pending{1};
+        std::mutex errorMutex;
+        std::exception_ptr error;
+    };
+
+    using TaskHandle=std::shared_ptr<Task>;
+
+    // Work-stealing pool: every worker owns a deque, pops its own work
+    // from the back and steals from the front of the others when idle.
+    class Scheduler{
+    public:
+        explicit Scheduler(uint32_t workerCount=std::thread::hardware_concurrency());
+        ~Scheduler();
+        Scheduler(const Scheduler&)=delete;
+        Scheduler& operator=(const Scheduler&)=delete;
+
+        // The process-wide pool that //parser and //renderer share,
+        // so going parallel in several places never oversubscribes.
+        static Scheduler& shared();
+
+        TaskHandle submit(
+            std::function<void()> fn,
+            const TaskHandle& parent=nullptr
+        );
+        // Runs queued work on the calling thread until task and all of
+        // its children are done, sleeping while there is nothing to run.
+        // Rethrows the first error among them.
+        void wait(const TaskHandle& task);
+        // A task that is never queued, children submitted under it are
+        // waited on together once the group is sealed.
+        TaskHandle group();
+        void seal(const TaskHandle& group);
+        // Splits [begin,end) into chunks of at most grain indices and
+        // blocks until fn has run on every chunk.
+        void parallelFor(
+            size_t begin,
+            size_t end,
+            size_t grain,
+            const std::function<void(size_t,size_t)>& fn
+        );
+        uint32_t workerCount() const;
+
+    private:
+        struct Worker{
+            std::mutex mutex;
+            std::deque<TaskHandle> tasks;
+            std::thread thread;
+        };
+
+        void push(TaskHandle task);
+        TaskHandle pop(int32_t self);
+        void execute(const TaskHandle& task);
+        void finish(const TaskHandle& task);
+        void workerLoop(uint32_t index);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<bool> running{true};
+        std::atomic<uint32_t> nextWorker{0};
+        std::atomic<size_t> queued{0};
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        // Threads blocked in wait(), woken when a task completes or
+        // work is queued.
+        std::atomic<uint32_t> waiters{0};
+        std::condition_variable finished;
+    };
+};
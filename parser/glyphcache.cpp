@@ -0,0 +1,101 @@
+#include "glyphcache.hpp"
+#include <iomanip>
+#include <ostream>
+
+namespace{
+    const char* bucketName(uint32_t bucket){
+        switch(bucket){
+            case 0: return "<=12px";
+            case 1: return "<=32px";
+            case 2: return "<=96px";
+            default: return ">96px";
+        }
+    }
+
+    size_t outlineBytes(const Outline& outline){
+        return sizeof(Outline)+
+               outline.points.capacity()*sizeof(glm::vec2)+
+               outline.indices.capacity()*sizeof(uint32_t);
+    }
+}
+
+GlyphCache::GlyphCache(
+    size_t byteLimit,
+    float screenTolerance
+):byteLimit(byteLimit),screenTolerance(screenTolerance){}
+
+uint32_t GlyphCache::bucket(float pixelSize){
+    uint32_t bucket=0;
+    while(bucket<bucketLimits.size() && pixelSize>bucketLimits[bucket]) bucket++;
+    return bucket;
+}
+
+float GlyphCache::tolerance(FT_Face face,uint32_t bucket) const{
+    float faceSize=static_cast<float>(face->size->metrics.y_ppem);
+    float screenSize=bucket<bucketLimits.size()?bucketLimits[bucket]:topSize;
+    return screenTolerance*faceSize/screenSize;
+}
+
+uint64_t GlyphCache::key(FT_UInt glyph,uint32_t bucket,IndexMode mode){
+    return static_cast<uint64_t>(glyph) |
+           static_cast<uint64_t>(bucket)<<32 |
+           static_cast<uint64_t>(mode)<<40;
+}
+
+std::shared_ptr<const Outline> GlyphCache::find(FT_UInt glyph,uint32_t bucket,IndexMode mode){
+    auto it=lookup.find(key(glyph,bucket,mode));
+    if(it==lookup.end()) return nullptr;
+    lru.splice(lru.begin(),lru,it->second);
+    stats[bucket].hits++;
+    return it->second->outline;
+}
+
+std::shared_ptr<const Outline> GlyphCache::insert(FT_UInt glyph,uint32_t bucket,IndexMode mode,Outline outline){
+    uint64_t entryKey=key(glyph,bucket,mode);
+    auto it=lookup.find(entryKey);
+    if(it!=lookup.end()){
+        usedBytes-=it->second->bytes;
+        lru.erase(it->second);
+        lookup.erase(it);
+    }
+    stats[bucket].builds++;
+    stats[bucket].vertices+=outline.points.size();
+    size_t bytes=outlineBytes(outline);
+    auto shared=std::make_shared<const Outline>(std::move(outline));
+    lru.push_front({entryKey,bucket,bytes,shared});
+    lookup[entryKey]=lru.begin();
+    usedBytes+=bytes;
+    evict();
+    return shared;
+}
+
+void GlyphCache::evict(){
+    // The newest entry is kept even on its own past the limit, callers
+    // hold on to it anyway.
+    while(usedBytes>byteLimit && lru.size()>1){
+        const Entry& oldest=lru.back();
+        usedBytes-=oldest.bytes;
+        stats[oldest.bucket].evictions++;
+        lookup.erase(oldest.key);
+        lru.pop_back();
+    }
+}
+
+void GlyphCache::clear(){
+    lru.clear();
+    lookup.clear();
+    usedBytes=0;
+}
+
+void GlyphCache::report(std::ostream& out) const{
+    out<<"glyph cache: "<<lru.size()<<" entries, "<<usedBytes<<" of "<<byteLimit<<" bytes\n";
+    for(uint32_t bucket=0;bucket<bucketCount;bucket++){
+        const BucketStats& s=stats[bucket];
+        uint64_t perGlyph=s.builds?s.vertices/s.builds:0;
+        out<<"  "<<std::left<<std::setw(7)<<bucketName(bucket)<<std::right
+           <<std::setw(8)<<s.hits<<" hits "
+           <<std::setw(6)<<s.builds<<" builds "
+           <<std::setw(6)<<s.evictions<<" evictions "
+           <<std::setw(5)<<perGlyph<<" vertices/glyph\n";
+    }
+}
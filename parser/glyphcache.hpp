@@ -0,0 +1,68 @@
+#pragma once
+#include "parser.hpp"
+#include <array>
+#include <iosfwd>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// Flattened glyph outlines kept at a few levels of detail. A glyph is
+// flattened once per size bucket, with a tolerance fine enough for the
+// largest on-screen size in that bucket, so small text gets by with a
+// fraction of the vertices while large text stays smooth. Entries are
+// built on first use and the least recently used ones are dropped once
+// the cache grows past its byte limit.
+//
+// Outlines are stored around the glyph's origin in the face's pixel
+// space. Not thread-safe, it is used from the thread that owns the face.
+class GlyphCache{
+public:
+    // On-screen pixel sizes bounding each bucket, anything larger goes
+    // to the last one which is flattened as if drawn at topSize.
+    static constexpr std::array<float,3> bucketLimits{12.0f,32.0f,96.0f};
+    static constexpr uint32_t bucketCount=bucketLimits.size()+1;
+    static constexpr float topSize=256.0f;
+
+    explicit GlyphCache(size_t byteLimit=16<<20,float screenTolerance=0.25f);
+
+    static uint32_t bucket(float pixelSize);
+    // Flattening tolerance in face pixels for glyphs of face drawn in
+    // bucket, i.e. the screen tolerance scaled back by the zoom.
+    float tolerance(FT_Face face,uint32_t bucket) const;
+
+    // Returns nullptr on a miss and marks the entry as used on a hit.
+    std::shared_ptr<const Outline> find(FT_UInt glyph,uint32_t bucket,IndexMode mode);
+    // Handles stay valid after their entry is evicted.
+    std::shared_ptr<const Outline> insert(FT_UInt glyph,uint32_t bucket,IndexMode mode,Outline outline);
+    // Drops every entry, e.g. when the face behind them changed.
+    void clear();
+
+    size_t bytes() const{ return usedBytes; }
+    size_t entries() const{ return lru.size(); }
+    void report(std::ostream& out) const;
+
+private:
+    struct Entry{
+        uint64_t key;
+        uint32_t bucket;
+        size_t bytes;
+        std::shared_ptr<const Outline> outline;
+    };
+    struct BucketStats{
+        uint64_t hits=0;
+        uint64_t builds=0;
+        uint64_t evictions=0;
+        uint64_t vertices=0;
+    };
+
+    static uint64_t key(FT_UInt glyph,uint32_t bucket,IndexMode mode);
+    void evict();
+
+    size_t byteLimit;
+    float screenTolerance;
+    size_t usedBytes=0;
+    // Front is the most recently used entry.
+    std::list<Entry> lru;
+    std::unordered_map<uint64_t,std::list<Entry>::iterator> lookup;
+    std::array<BucketStats,bucketCount> stats;
+};
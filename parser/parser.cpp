@@ -1,12 +1,450 @@
 #include "parser.hpp"
+#include "glyphcache.hpp"
+#include <jobs/jobs.hpp>
 #include <stdexcept>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <memory>
 
-int main(){
-    FT_Library library;
-    FT_Face face;
-    FT_Glyph glyph;
-    FT_Error err;
+namespace{
+    // Points are keyed on the 26.6 grid FreeType works in, so two
+    // segments meeting at the same spot always share one vertex.
+    uint64_t gridKey(glm::vec2 p){
+        int32_t qx=static_cast<int32_t>(std::lround(p.x*64.0f));
+        int32_t qy=static_cast<int32_t>(std::lround(p.y*64.0f));
+        return (static_cast<uint64_t>(static_cast<uint32_t>(qx))<<32) |
+               static_cast<uint32_t>(qy);
+    }
 
-    err=FT_Init_FreeType(&library);
-    if(err) throw std::runtime_error("Failed to init");
-}
\ No newline at end of file
+    struct Flattener{
+        Outline& outline;
+        float tolerance;
+        glm::vec2 origin{0.0f,0.0f};
+        glm::vec2 last{0.0f,0.0f};
+        std::unordered_map<uint64_t,uint32_t> lookup{};
+        std::vector<uint32_t> contour{};
+
+        glm::vec2 toPixel(const FT_Vector* v) const{
+            return {origin.x+v->x/64.0f, origin.y-v->y/64.0f};
+        }
+
+        uint32_t vertex(glm::vec2 p){
+            auto [it,inserted]=lookup.try_emplace(gridKey(p),static_cast<uint32_t>(outline.points.size()));
+            if(inserted) outline.points.push_back(p);
+            return it->second;
+        }
+
+        void point(glm::vec2 p){
+            uint32_t index=vertex(p);
+            if(contour.empty() || contour.back()!=index) contour.push_back(index);
+            last=p;
+        }
+
+        void closeContour(){
+            if(contour.size()>1 && contour.back()==contour.front()) contour.pop_back();
+            if(contour.size()<2){
+                contour.clear();
+                return;
+            }
+            if(outline.mode==IndexMode::eLineStrip){
+                outline.indices.insert(outline.indices.end(),contour.begin(),contour.end());
+                outline.indices.push_back(contour.front());
+                outline.indices.push_back(ps::restartIndex);
+            }else{
+                for(size_t i=0;i<contour.size();i++){
+                    outline.indices.push_back(contour[i]);
+                    outline.indices.push_back(contour[(i+1)%contour.size()]);
+                }
+            }
+            contour.clear();
+        }
+
+        uint32_t segments(float deviation) const{
+            return std::max(1u,static_cast<uint32_t>(std::ceil(std::sqrt(deviation/(4.0f*tolerance)))));
+        }
+    };
+
+    int moveTo(const FT_Vector* to, void* user){
+        auto* f=static_cast<Flattener*>(user);
+        f->closeContour();
+        f->point(f->toPixel(to));
+        return 0;
+    }
+
+    int lineTo(const FT_Vector* to, void* user){
+        auto* f=static_cast<Flattener*>(user);
+        f->point(f->toPixel(to));
+        return 0;
+    }
+
+    int conicTo(const FT_Vector* control, const FT_Vector* to, void* user){
+        auto* f=static_cast<Flattener*>(user);
+        glm::vec2 p0=f->last;
+        glm::vec2 p1=f->toPixel(control);
+        glm::vec2 p2=f->toPixel(to);
+        uint32_t n=f->segments(glm::length(p0-p1*2.0f+p2));
+        for(uint32_t i=1;i<=n;i++){
+            float t=static_cast<float>(i)/n;
+            float mt=1.0f-t;
+            f->point(p0*(mt*mt)+p1*(2.0f*mt*t)+p2*(t*t));
+        }
+        return 0;
+    }
+
+    int cubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user){
+        auto* f=static_cast<Flattener*>(user);
+        glm::vec2 p0=f->last;
+        glm::vec2 p1=f->toPixel(control1);
+        glm::vec2 p2=f->toPixel(control2);
+        glm::vec2 p3=f->toPixel(to);
+        float deviation=std::max(
+            glm::length(p0-p1*2.0f+p2),
+            glm::length(p1-p2*2.0f+p3)
+        );
+        uint32_t n=f->segments(deviation*1.5f);
+        for(uint32_t i=1;i<=n;i++){
+            float t=static_cast<float>(i)/n;
+            float mt=1.0f-t;
+            f->point(p0*(mt*mt*mt)+p1*(3.0f*mt*mt*t)+p2*(3.0f*mt*t*t)+p3*(t*t*t));
+        }
+        return 0;
+    }
+
+    struct CurveBuilder{
+        CurveMesh& mesh;
+        glm::vec2 origin{0.0f,0.0f};
+        glm::vec2 last{0.0f,0.0f};
+        std::unordered_map<uint64_t,uint32_t> lookup{};
+        std::vector<uint32_t> polygon{};
+
+        glm::vec2 toPixel(const FT_Vector* v) const{
+            return {origin.x+v->x/64.0f, origin.y-v->y/64.0f};
+        }
+
+        uint32_t fanVertex(glm::vec2 p){
+            auto [it,inserted]=lookup.try_emplace(gridKey(p),static_cast<uint32_t>(mesh.points.size()));
+            if(inserted) mesh.points.push_back({p,{0.0f,1.0f}});
+            return it->second;
+        }
+
+        void point(glm::vec2 p){
+            uint32_t index=fanVertex(p);
+            if(polygon.empty() || polygon.back()!=index) polygon.push_back(index);
+            last=p;
+        }
+
+        void curve(glm::vec2 p0,glm::vec2 p1,glm::vec2 p2){
+            uint32_t base=static_cast<uint32_t>(mesh.points.size());
+            mesh.points.push_back({p0,{0.0f,0.0f}});
+            mesh.points.push_back({p1,{0.5f,0.0f}});
+            mesh.points.push_back({p2,{1.0f,1.0f}});
+            mesh.indices.insert(mesh.indices.end(),{base,base+1,base+2});
+            point(p2);
+        }
+
+        void closeContour(){
+            for(size_t i=1;i+1<polygon.size();i++){
+                mesh.indices.insert(mesh.indices.end(),{polygon[0],polygon[i],polygon[i+1]});
+            }
+            polygon.clear();
+        }
+    };
+
+    int curveMoveTo(const FT_Vector* to, void* user){
+        auto* b=static_cast<CurveBuilder*>(user);
+        b->closeContour();
+        b->point(b->toPixel(to));
+        return 0;
+    }
+
+    int curveLineTo(const FT_Vector* to, void* user){
+        auto* b=static_cast<CurveBuilder*>(user);
+        b->point(b->toPixel(to));
+        return 0;
+    }
+
+    int curveConicTo(const FT_Vector* control, const FT_Vector* to, void* user){
+        auto* b=static_cast<CurveBuilder*>(user);
+        b->curve(b->last,b->toPixel(control),b->toPixel(to));
+        return 0;
+    }
+
+    int curveCubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user){
+        auto* b=static_cast<CurveBuilder*>(user);
+        glm::vec2 p0=b->last;
+        glm::vec2 p1=b->toPixel(control1);
+        glm::vec2 p2=b->toPixel(control2);
+        glm::vec2 p3=b->toPixel(to);
+        // Split at t=0.5 and fit one quadratic to each half.
+        glm::vec2 p01=(p0+p1)*0.5f, p12=(p1+p2)*0.5f, p23=(p2+p3)*0.5f;
+        glm::vec2 p012=(p01+p12)*0.5f, p123=(p12+p23)*0.5f;
+        glm::vec2 mid=(p012+p123)*0.5f;
+        b->curve(p0,(p01*3.0f+p012*3.0f-p0-mid)*0.25f,mid);
+        b->curve(mid,(p123*3.0f+p23*3.0f-mid-p3)*0.25f,p3);
+        return 0;
+    }
+
+    // Walks the glyphs of text and calls fn with the pen position of
+    // every outline glyph while it is loaded into face->glyph.
+    template<typename Fn>
+    void layoutGlyphs(
+        FT_Face face,
+        const std::string& text,
+        Fn&& fn
+    ){
+        float lineHeight=face->size->metrics.height/64.0f;
+        glm::vec2 pen{0.0f,0.0f};
+        for(unsigned char c:text){
+            if(c=='\n'){
+                pen=glm::vec2(0.0f,pen.y+lineHeight);
+                continue;
+            }
+            FT_Error err=FT_Load_Char(face,c,FT_LOAD_NO_BITMAP);
+            if(err) throw std::runtime_error("Failed to load glyph");
+            if(face->glyph->format==FT_GLYPH_FORMAT_OUTLINE) fn(pen);
+
+            pen.x+=face->glyph->advance.x/64.0f;
+        }
+    }
+
+    template<typename Builder>
+    void decompose(
+        FT_Outline* outline,
+        const FT_Outline_Funcs& funcs,
+        Builder& builder,
+        glm::vec2 origin
+    ){
+        builder.origin=origin;
+        FT_Error err=FT_Outline_Decompose(outline,&funcs,&builder);
+        if(err) throw std::runtime_error("Failed to decompose outline");
+        builder.closeContour();
+    }
+
+    // Runs are recorded with only their first index while building,
+    // this fills in the counts, drops empty lines and computes bounds.
+    template<typename PointFn>
+    void finishRuns(
+        std::vector<TextRun>& runs,
+        const std::vector<uint32_t>& indices,
+        PointFn&& point
+    ){
+        std::vector<TextRun> finished;
+        finished.reserve(runs.size());
+        for(size_t i=0;i<runs.size();i++){
+            uint32_t end=i+1<runs.size()?runs[i+1].firstIndex:static_cast<uint32_t>(indices.size());
+            TextRun run=runs[i];
+            run.indexCount=end-run.firstIndex;
+            if(run.indexCount==0) continue;
+            run.min=glm::vec2(INFINITY);
+            run.max=glm::vec2(-INFINITY);
+            for(uint32_t j=run.firstIndex;j<end;j++){
+                if(indices[j]==ps::restartIndex) continue;
+                glm::vec2 p=point(indices[j]);
+                run.min=glm::min(run.min,p);
+                run.max=glm::max(run.max,p);
+            }
+            finished.push_back(run);
+        }
+        runs=std::move(finished);
+    }
+
+    using GlyphPtr=std::unique_ptr<FT_GlyphRec_,decltype(&FT_Done_Glyph)>;
+
+    struct PlacedGlyph{
+        GlyphPtr glyph;
+        glm::vec2 origin;
+    };
+
+    // A glyph outline flattened around (0,0) and where it goes.
+    struct PlacedPart{
+        const Outline* outline;
+        glm::vec2 origin;
+    };
+
+    // Moves every part to its origin and merges them into one vertex
+    // list, so neighbouring glyphs share points too. A new run starts
+    // whenever the origin moves to another line.
+    Outline merge(const std::vector<PlacedPart>& parts,IndexMode mode){
+        Outline result{};
+        result.mode=mode;
+        std::unordered_map<uint64_t,uint32_t> lookup;
+        std::vector<uint32_t> remap;
+        for(size_t partIndex=0;partIndex<parts.size();partIndex++){
+            const Outline& part=*parts[partIndex].outline;
+            glm::vec2 origin=parts[partIndex].origin;
+            if(partIndex==0 || origin.y!=parts[partIndex-1].origin.y){
+                result.runs.push_back({static_cast<uint32_t>(result.indices.size()),0,{0.0f,0.0f},{0.0f,0.0f}});
+            }
+            remap.resize(part.points.size());
+            for(size_t i=0;i<part.points.size();i++){
+                glm::vec2 p=part.points[i]+origin;
+                auto [it,inserted]=lookup.try_emplace(gridKey(p),static_cast<uint32_t>(result.points.size()));
+                if(inserted) result.points.push_back(p);
+                remap[i]=it->second;
+            }
+            for(uint32_t index:part.indices){
+                result.indices.push_back(index==ps::restartIndex?index:remap[index]);
+            }
+        }
+        finishRuns(result.runs,result.indices,[&](uint32_t index){
+            return result.points[index];
+        });
+        return result;
+    }
+}
+
+namespace ps::create{
+    FT_Library library(){
+        FT_Library library;
+        FT_Error err=FT_Init_FreeType(&library);
+        if(err) throw std::runtime_error("Failed to init FreeType");
+        return library;
+    }
+
+    FT_Face face(
+        FT_Library library,
+        const std::string& path,
+        uint32_t pixelSize
+    ){
+        FT_Face face;
+        FT_Error err=FT_New_Face(library,path.c_str(),0,&face);
+        if(err) throw std::runtime_error("Failed to load font: "+path);
+        err=FT_Set_Pixel_Sizes(face,0,pixelSize);
+        if(err) throw std::runtime_error("Failed to set pixel size");
+        return face;
+    }
+}
+
+namespace ps::utils{
+    Outline outline(
+        FT_Face face,
+        const std::string& text,
+        IndexMode mode,
+        float tolerance
+    ){
+        // FT_Face is not thread-safe, so glyphs are loaded and copied
+        // here and only the flattening fans out to the shared pool.
+        std::vector<PlacedGlyph> glyphs;
+        layoutGlyphs(face,text,[&](glm::vec2 pen){
+            FT_Glyph glyph;
+            FT_Error err=FT_Get_Glyph(face->glyph,&glyph);
+            if(err) throw std::runtime_error("Failed to copy glyph");
+            glyphs.push_back({GlyphPtr(glyph,FT_Done_Glyph),pen});
+        });
+
+        std::vector<Outline> parts(glyphs.size());
+        js::Scheduler::shared().parallelFor(0,glyphs.size(),16,[&](size_t first,size_t last){
+            for(size_t i=first;i<last;i++){
+                auto* outlineGlyph=reinterpret_cast<FT_OutlineGlyph>(glyphs[i].glyph.get());
+                parts[i]=flatten(&outlineGlyph->outline,glm::vec2(0.0f),mode,tolerance);
+            }
+        });
+
+        std::vector<PlacedPart> placed;
+        placed.reserve(parts.size());
+        for(size_t i=0;i<parts.size();i++) placed.push_back({&parts[i],glyphs[i].origin});
+        return merge(placed,mode);
+    }
+
+    Outline outline(
+        FT_Face face,
+        const std::string& text,
+        GlyphCache& cache,
+        float pixelSize,
+        IndexMode mode
+    ){
+        uint32_t bucket=GlyphCache::bucket(pixelSize);
+        float tolerance=cache.tolerance(face,bucket);
+
+        // Hits are taken from the cache as the text is laid out, each
+        // missing glyph is copied once and flattened on the pool.
+        struct Miss{
+            FT_UInt index;
+            GlyphPtr glyph;
+            Outline outline;
+        };
+        std::vector<std::shared_ptr<const Outline>> parts;
+        std::vector<glm::vec2> origins;
+        std::vector<Miss> misses;
+        std::unordered_map<FT_UInt,size_t> missSlots;
+        std::vector<std::pair<size_t,size_t>> pending;
+        layoutGlyphs(face,text,[&](glm::vec2 pen){
+            FT_UInt index=face->glyph->glyph_index;
+            origins.push_back(pen);
+            parts.push_back(cache.find(index,bucket,mode));
+            if(parts.back()) return;
+            auto [it,inserted]=missSlots.try_emplace(index,misses.size());
+            if(inserted){
+                FT_Glyph glyph;
+                FT_Error err=FT_Get_Glyph(face->glyph,&glyph);
+                if(err) throw std::runtime_error("Failed to copy glyph");
+                misses.push_back({index,GlyphPtr(glyph,FT_Done_Glyph),{}});
+            }
+            pending.push_back({parts.size()-1,it->second});
+        });
+
+        js::Scheduler::shared().parallelFor(0,misses.size(),16,[&](size_t first,size_t last){
+            for(size_t i=first;i<last;i++){
+                auto* outlineGlyph=reinterpret_cast<FT_OutlineGlyph>(misses[i].glyph.get());
+                misses[i].outline=flatten(&outlineGlyph->outline,glm::vec2(0.0f),mode,tolerance);
+            }
+        });
+        std::vector<std::shared_ptr<const Outline>> built(misses.size());
+        for(size_t i=0;i<misses.size();i++){
+            built[i]=cache.insert(misses[i].index,bucket,mode,std::move(misses[i].outline));
+        }
+        for(auto [part,miss]:pending) parts[part]=built[miss];
+
+        std::vector<PlacedPart> placed;
+        placed.reserve(parts.size());
+        for(size_t i=0;i<parts.size();i++) placed.push_back({parts[i].get(),origins[i]});
+        return merge(placed,mode);
+    }
+
+    Outline flatten(
+        FT_Outline* outline,
+        glm::vec2 origin,
+        IndexMode mode,
+        float tolerance
+    ){
+        FT_Outline_Funcs funcs{};
+        funcs.move_to=moveTo;
+        funcs.line_to=lineTo;
+        funcs.conic_to=conicTo;
+        funcs.cubic_to=cubicTo;
+
+        Outline result{};
+        result.mode=mode;
+        Flattener flattener{result,tolerance};
+        decompose(outline,funcs,flattener,origin);
+        return result;
+    }
+
+    CurveMesh curves(
+        FT_Face face,
+        const std::string& text
+    ){
+        CurveMesh result{};
+        CurveBuilder builder{result};
+
+        FT_Outline_Funcs funcs{};
+        funcs.move_to=curveMoveTo;
+        funcs.line_to=curveLineTo;
+        funcs.conic_to=curveConicTo;
+        funcs.cubic_to=curveCubicTo;
+
+        float lineY=0.0f;
+        layoutGlyphs(face,text,[&](glm::vec2 pen){
+            if(result.runs.empty() || pen.y!=lineY){
+                result.runs.push_back({static_cast<uint32_t>(result.indices.size()),0,{0.0f,0.0f},{0.0f,0.0f}});
+                lineY=pen.y;
+            }
+            decompose(&face->glyph->outline,funcs,builder,pen);
+        });
+        finishRuns(result.runs,result.indices,[&](uint32_t index){
+            return result.points[index].pos;
+        });
+        return result;
+    }
+}
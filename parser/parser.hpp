@@ -1,4 +1,100 @@
+#pragma once
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
-#include <ftmodule.h>
\ No newline at end of file
+#include FT_OUTLINE_H
+#include <ftmodule.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+enum class IndexMode{
+    eLineList,
+    eLineStrip
+};
+
+// The indices of one laid out line and the pixel-space box around
+// them, so a renderer can cull whole lines without touching vertices.
+struct TextRun{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    glm::vec2 min;
+    glm::vec2 max;
+};
+
+struct Outline{
+    std::vector<glm::vec2> points;
+    std::vector<uint32_t> indices;
+    IndexMode mode;
+    std::vector<TextRun> runs;
+};
+
+// A vertex of the curve mesh. uv is the Loop-Blinn coordinate the
+// fragment stage tests against u*u-v, fan vertices use (0,1) so they
+// are always kept.
+struct CurvePoint{
+    glm::vec2 pos;
+    glm::vec2 uv;
+};
+
+// Triangle list drawn with invert blending: the contour fans and the
+// curve triangles toggle coverage, which yields the even-odd fill.
+struct CurveMesh{
+    std::vector<CurvePoint> points;
+    std::vector<uint32_t> indices;
+    std::vector<TextRun> runs;
+};
+
+class GlyphCache;
+
+namespace ps{
+    // Index that ends a contour in IndexMode::eLineStrip, matches
+    // the value Vulkan uses for primitive restart with eUint32 indices.
+    constexpr uint32_t restartIndex=0xFFFFFFFF;
+
+    namespace create{
+        FT_Library library();
+        FT_Face face(
+            FT_Library library,
+            const std::string& path,
+            uint32_t pixelSize
+        );
+    };
+    namespace utils{
+        // Flattens every contour of every glyph in text into one
+        // shared, deduplicated vertex list in pixel space (y down,
+        // origin at the pen start on the baseline). vo::create::pipeline
+        // draws line strips with primitive restart, so only eLineStrip
+        // indices render correctly there.
+        Outline outline(
+            FT_Face face,
+            const std::string& text,
+            IndexMode mode=IndexMode::eLineStrip,
+            float tolerance=0.25f
+        );
+        // Same layout as above with each glyph taken from cache at the
+        // level of detail for text drawn pixelSize pixels tall.
+        Outline outline(
+            FT_Face face,
+            const std::string& text,
+            GlyphCache& cache,
+            float pixelSize,
+            IndexMode mode=IndexMode::eLineStrip
+        );
+        // Flattens a single outline into line segments in pixel space,
+        // y down, with the outline's origin placed at origin.
+        Outline flatten(
+            FT_Outline* outline,
+            glm::vec2 origin,
+            IndexMode mode=IndexMode::eLineList,
+            float tolerance=0.25f
+        );
+        // Emits the quadratic control points as-is for GPU evaluation,
+        // cubic segments are approximated by two quadratics.
+        CurveMesh curves(
+            FT_Face face,
+            const std::string& text
+        );
+    };
+};
@@ -0,0 +1,505 @@
+#include "raster.hpp"
+#include <jobs/jobs.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PS_RASTER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define PS_RASTER_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Kernels for wider instruction sets are compiled per function so the
+// rest of the build keeps its baseline flags; MSVC needs no attribute.
+#if defined(__GNUC__) || defined(__clang__)
+#define PS_TARGET(features) __attribute__((target(features)))
+#else
+#define PS_TARGET(features)
+#endif
+
+namespace{
+    // Kernels write whole vectors, the buffer is padded to this many
+    // floats past the last pixel.
+    const size_t cellPadding=8;
+
+    uint8_t toCoverage(float accumulated){
+        float coverage=std::min(std::fabs(accumulated),1.0f);
+        return static_cast<uint8_t>(coverage*255.0f+0.5f);
+    }
+
+    float resolveScalar(const float* cells,uint8_t* out,size_t begin,size_t end,float accumulated){
+        for(size_t i=begin;i<end;i++){
+            accumulated+=cells[i];
+            out[i]=toCoverage(accumulated);
+        }
+        return accumulated;
+    }
+
+#if PS_RASTER_X86
+    PS_TARGET("sse2")
+    void resolveSse2(const float* cells,uint8_t* out,size_t count){
+        const __m128 absMask=_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 one=_mm_set1_ps(1.0f);
+        const __m128 scale=_mm_set1_ps(255.0f);
+        const __m128 half=_mm_set1_ps(0.5f);
+        __m128 offset=_mm_setzero_ps();
+        size_t i=0;
+        for(;i+4<=count;i+=4){
+            // In-register inclusive scan: add the vector shifted by one
+            // and then by two lanes, then the running total so far.
+            __m128 x=_mm_loadu_ps(cells+i);
+            x=_mm_add_ps(x,_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x),4)));
+            x=_mm_add_ps(x,_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x),8)));
+            x=_mm_add_ps(x,offset);
+            offset=_mm_shuffle_ps(x,x,_MM_SHUFFLE(3,3,3,3));
+
+            __m128 coverage=_mm_min_ps(_mm_and_ps(x,absMask),one);
+            __m128i value=_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(coverage,scale),half));
+            value=_mm_packs_epi32(value,value);
+            value=_mm_packus_epi16(value,value);
+            int32_t packed=_mm_cvtsi128_si32(value);
+            std::memcpy(out+i,&packed,sizeof(packed));
+        }
+        resolveScalar(cells,out,i,count,_mm_cvtss_f32(offset));
+    }
+
+    PS_TARGET("avx2")
+    void resolveAvx2(const float* cells,uint8_t* out,size_t count){
+        const __m256 absMask=_mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const __m256 one=_mm256_set1_ps(1.0f);
+        const __m256 scale=_mm256_set1_ps(255.0f);
+        const __m256 half=_mm256_set1_ps(0.5f);
+        const __m256i lowLast=_mm256_setr_epi32(0,0,0,0,3,3,3,3);
+        const __m256i last=_mm256_set1_epi32(7);
+        __m256 offset=_mm256_setzero_ps();
+        size_t i=0;
+        for(;i+8<=count;i+=8){
+            // Byte shifts stay within 128-bit lanes, so scan each lane
+            // and then carry the low lane's total into the high one.
+            __m256 x=_mm256_loadu_ps(cells+i);
+            x=_mm256_add_ps(x,_mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x),4)));
+            x=_mm256_add_ps(x,_mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x),8)));
+            __m256 carry=_mm256_permutevar8x32_ps(x,lowLast);
+            x=_mm256_add_ps(x,_mm256_blend_ps(_mm256_setzero_ps(),carry,0xF0));
+            x=_mm256_add_ps(x,offset);
+            offset=_mm256_permutevar8x32_ps(x,last);
+
+            __m256 coverage=_mm256_min_ps(_mm256_and_ps(x,absMask),one);
+            __m256i value=_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(coverage,scale),half));
+            __m128i packed=_mm_packs_epi32(_mm256_castsi256_si128(value),_mm256_extracti128_si256(value,1));
+            packed=_mm_packus_epi16(packed,packed);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out+i),packed);
+        }
+        resolveScalar(cells,out,i,count,_mm256_cvtss_f32(offset));
+    }
+
+#if defined(_MSC_VER)
+    PS_TARGET("xsave")
+    bool osSavesAvx(){
+        return (_xgetbv(0)&6)==6;
+    }
+#endif
+
+    bool cpuHasAvx2(){
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info,0);
+        if(info[0]<7) return false;
+        __cpuid(info,1);
+        bool osxsave=info[2]&(1<<27);
+        bool avx=info[2]&(1<<28);
+        if(!osxsave || !avx || !osSavesAvx()) return false;
+        __cpuidex(info,7,0);
+        return info[1]&(1<<5);
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    bool cpuHasSse2(){
+#if defined(__x86_64__) || defined(_M_X64)
+        return true;
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info,1);
+        return info[3]&(1<<26);
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+#endif
+    }
+#endif
+
+#if PS_RASTER_NEON
+    void resolveNeon(const float* cells,uint8_t* out,size_t count){
+        const float32x4_t zero=vdupq_n_f32(0.0f);
+        const float32x4_t one=vdupq_n_f32(1.0f);
+        const float32x4_t scale=vdupq_n_f32(255.0f);
+        const float32x4_t half=vdupq_n_f32(0.5f);
+        float32x4_t offset=zero;
+        size_t i=0;
+        for(;i+4<=count;i+=4){
+            // vext against zero shifts the lanes up by one and by two.
+            float32x4_t x=vld1q_f32(cells+i);
+            x=vaddq_f32(x,vextq_f32(zero,x,3));
+            x=vaddq_f32(x,vextq_f32(zero,x,2));
+            x=vaddq_f32(x,offset);
+            offset=vdupq_n_f32(vgetq_lane_f32(x,3));
+
+            float32x4_t coverage=vminq_f32(vabsq_f32(x),one);
+            uint32x4_t value=vcvtq_u32_f32(vmlaq_f32(half,coverage,scale));
+            uint16x4_t narrow=vmovn_u32(value);
+            uint8x8_t bytes=vmovn_u16(vcombine_u16(narrow,narrow));
+            uint32_t packed=vget_lane_u32(vreinterpret_u32_u8(bytes),0);
+            std::memcpy(out+i,&packed,sizeof(packed));
+        }
+        resolveScalar(cells,out,i,count,vgetq_lane_f32(offset,0));
+    }
+#endif
+
+    using GlyphPtr=std::unique_ptr<FT_GlyphRec_,decltype(&FT_Done_Glyph)>;
+
+    // Flattens straight into the accumulator. Segment order and
+    // orientation are all the rasterizer needs, so unlike
+    // ps::utils::flatten no vertices are shared or indexed.
+    struct LineSink{
+        Accumulator& accumulator;
+        float tolerance;
+        glm::vec2 origin;
+        glm::vec2 start{0.0f,0.0f};
+        glm::vec2 last{0.0f,0.0f};
+        bool open=false;
+
+        glm::vec2 toPixel(const FT_Vector* v) const{
+            return {origin.x+v->x/64.0f, origin.y-v->y/64.0f};
+        }
+
+        void point(glm::vec2 p){
+            accumulator.line(last,p);
+            last=p;
+        }
+
+        void closeContour(){
+            if(open) accumulator.line(last,start);
+            open=false;
+        }
+
+        uint32_t segments(float deviation) const{
+            return std::max(1u,static_cast<uint32_t>(std::ceil(std::sqrt(deviation/(4.0f*tolerance)))));
+        }
+    };
+
+    int sinkMoveTo(const FT_Vector* to, void* user){
+        auto* s=static_cast<LineSink*>(user);
+        s->closeContour();
+        s->start=s->last=s->toPixel(to);
+        s->open=true;
+        return 0;
+    }
+
+    int sinkLineTo(const FT_Vector* to, void* user){
+        auto* s=static_cast<LineSink*>(user);
+        s->point(s->toPixel(to));
+        return 0;
+    }
+
+    int sinkConicTo(const FT_Vector* control, const FT_Vector* to, void* user){
+        auto* s=static_cast<LineSink*>(user);
+        glm::vec2 p0=s->last;
+        glm::vec2 p1=s->toPixel(control);
+        glm::vec2 p2=s->toPixel(to);
+        uint32_t n=s->segments(glm::length(p0-p1*2.0f+p2));
+        for(uint32_t i=1;i<=n;i++){
+            float t=static_cast<float>(i)/n;
+            float mt=1.0f-t;
+            s->point(p0*(mt*mt)+p1*(2.0f*mt*t)+p2*(t*t));
+        }
+        return 0;
+    }
+
+    int sinkCubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user){
+        auto* s=static_cast<LineSink*>(user);
+        glm::vec2 p0=s->last;
+        glm::vec2 p1=s->toPixel(control1);
+        glm::vec2 p2=s->toPixel(control2);
+        glm::vec2 p3=s->toPixel(to);
+        float deviation=std::max(
+            glm::length(p0-p1*2.0f+p2),
+            glm::length(p1-p2*2.0f+p3)
+        );
+        uint32_t n=s->segments(deviation*1.5f);
+        for(uint32_t i=1;i<=n;i++){
+            float t=static_cast<float>(i)/n;
+            float mt=1.0f-t;
+            s->point(p0*(mt*mt*mt)+p1*(3.0f*mt*mt*t)+p2*(3.0f*mt*t*t)+p3*(t*t*t));
+        }
+        return 0;
+    }
+
+    // Same box FreeType's smooth renderer uses: the control box
+    // snapped outwards to whole pixels.
+    GlyphBitmap accumulate(
+        FT_Outline* outline,
+        PrefixKernel kernel,
+        float tolerance
+    ){
+        FT_BBox box;
+        FT_Outline_Get_CBox(outline,&box);
+        FT_Pos xMin=box.xMin & ~63;
+        FT_Pos yMin=box.yMin & ~63;
+        FT_Pos xMax=(box.xMax+63) & ~63;
+        FT_Pos yMax=(box.yMax+63) & ~63;
+
+        GlyphBitmap bitmap{
+            static_cast<uint32_t>((xMax-xMin)>>6),
+            static_cast<uint32_t>((yMax-yMin)>>6),
+            static_cast<int32_t>(xMin>>6),
+            static_cast<int32_t>(yMax>>6),
+            {}
+        };
+        if(bitmap.width==0 || bitmap.height==0) return bitmap;
+
+        Accumulator accumulator(bitmap.width,bitmap.height);
+        accumulator.path(outline,glm::vec2(-xMin/64.0f,yMax/64.0f),tolerance);
+        bitmap.pixels.resize(static_cast<size_t>(bitmap.width)*bitmap.height);
+        accumulator.resolve(bitmap.pixels.data(),kernel);
+        return bitmap;
+    }
+
+    GlyphBitmap copyBitmap(const FT_GlyphSlot slot){
+        const FT_Bitmap& source=slot->bitmap;
+        GlyphBitmap bitmap{
+            source.width,
+            source.rows,
+            slot->bitmap_left,
+            slot->bitmap_top,
+            std::vector<uint8_t>(static_cast<size_t>(source.width)*source.rows)
+        };
+        for(uint32_t row=0;row<source.rows;row++){
+            const unsigned char* line=source.pitch>=0?
+                source.buffer+row*source.pitch:
+                source.buffer+(source.rows-1-row)*(-source.pitch);
+            std::memcpy(bitmap.pixels.data()+row*bitmap.width,line,bitmap.width);
+        }
+        return bitmap;
+    }
+}
+
+Accumulator::Accumulator(
+    uint32_t width,
+    uint32_t height
+):width(width),height(height),cells(static_cast<size_t>(width)*height+cellPadding,0.0f){}
+
+void Accumulator::line(glm::vec2 p0,glm::vec2 p1){
+    if(std::fabs(p0.y-p1.y)<=1e-6f) return;
+    float direction=1.0f;
+    if(p0.y>p1.y){
+        std::swap(p0,p1);
+        direction=-1.0f;
+    }
+    float dxdy=(p1.x-p0.x)/(p1.y-p0.y);
+    float x=p0.x;
+    if(p0.y<0.0f) x-=p0.y*dxdy;
+    uint32_t yBegin=static_cast<uint32_t>(std::max(0.0f,p0.y));
+    uint32_t yEnd=std::min(height,static_cast<uint32_t>(std::max(0.0f,std::ceil(p1.y))));
+
+    for(uint32_t y=yBegin;y<yEnd;y++){
+        float* row=cells.data()+static_cast<size_t>(y)*width;
+        float dy=std::min(static_cast<float>(y+1),p1.y)-std::max(static_cast<float>(y),p0.y);
+        float xNext=x+dxdy*dy;
+        float d=dy*direction;
+        // Rounding can put a point a hair left of the box.
+        float x0=std::max(0.0f,std::min(x,xNext));
+        float x1=std::max(0.0f,std::max(x,xNext));
+        float x0Floor=std::floor(x0);
+        int32_t x0i=static_cast<int32_t>(x0Floor);
+        float x1Ceil=std::ceil(x1);
+        int32_t x1i=static_cast<int32_t>(x1Ceil);
+        if(x1i<=x0i+1){
+            // Crosses a single pixel: split d by where the segment's
+            // midpoint sits inside it.
+            float xMid=0.5f*(x+xNext)-x0Floor;
+            row[x0i]+=d-d*xMid;
+            row[x0i+1]+=d*xMid;
+        }else{
+            // Spans several pixels: the coverage ramps linearly, with
+            // quadratic partial areas in the first and last pixel.
+            float s=1.0f/(x1-x0);
+            float x0f=x0-x0Floor;
+            float a0=0.5f*s*(1.0f-x0f)*(1.0f-x0f);
+            float x1f=x1-x1Ceil+1.0f;
+            float am=0.5f*s*x1f*x1f;
+            row[x0i]+=d*a0;
+            if(x1i==x0i+2){
+                row[x0i+1]+=d*(1.0f-a0-am);
+            }else{
+                float a1=s*(1.5f-x0f);
+                row[x0i+1]+=d*(a1-a0);
+                for(int32_t xi=x0i+2;xi<x1i-1;xi++){
+                    row[xi]+=d*s;
+                }
+                float a2=a1+static_cast<float>(x1i-x0i-3)*s;
+                row[x1i-1]+=d*(1.0f-a2-am);
+            }
+            row[x1i]+=d*am;
+        }
+        x=xNext;
+    }
+}
+
+void Accumulator::outline(const Outline& outline){
+    const std::vector<uint32_t>& indices=outline.indices;
+    if(outline.mode==IndexMode::eLineList){
+        for(size_t i=0;i+1<indices.size();i+=2){
+            line(outline.points[indices[i]],outline.points[indices[i+1]]);
+        }
+        return;
+    }
+    for(size_t i=0;i+1<indices.size();i++){
+        if(indices[i]==ps::restartIndex || indices[i+1]==ps::restartIndex) continue;
+        line(outline.points[indices[i]],outline.points[indices[i+1]]);
+    }
+}
+
+void Accumulator::path(FT_Outline* outline,glm::vec2 origin,float tolerance){
+    FT_Outline_Funcs funcs{};
+    funcs.move_to=sinkMoveTo;
+    funcs.line_to=sinkLineTo;
+    funcs.conic_to=sinkConicTo;
+    funcs.cubic_to=sinkCubicTo;
+
+    LineSink sink{*this,tolerance,origin};
+    FT_Error err=FT_Outline_Decompose(outline,&funcs,&sink);
+    if(err) throw std::runtime_error("Failed to decompose outline");
+    sink.closeContour();
+}
+
+void Accumulator::resolve(uint8_t* out,PrefixKernel kernel) const{
+    // The scan runs over the whole buffer rather than per row, every
+    // closed contour sums to zero across a row so nothing carries over.
+    size_t count=static_cast<size_t>(width)*height;
+    switch(kernel){
+#if PS_RASTER_X86
+        case PrefixKernel::eSse2:
+            resolveSse2(cells.data(),out,count);
+            return;
+        case PrefixKernel::eAvx2:
+            resolveAvx2(cells.data(),out,count);
+            return;
+#endif
+#if PS_RASTER_NEON
+        case PrefixKernel::eNeon:
+            resolveNeon(cells.data(),out,count);
+            return;
+#endif
+        default:
+            resolveScalar(cells.data(),out,0,count,0.0f);
+            return;
+    }
+}
+
+namespace ps::utils{
+    bool supportsPrefixKernel(PrefixKernel kernel){
+        switch(kernel){
+            case PrefixKernel::eScalar:
+                return true;
+#if PS_RASTER_X86
+            case PrefixKernel::eSse2:
+                return cpuHasSse2();
+            case PrefixKernel::eAvx2:
+                return cpuHasAvx2();
+#endif
+#if PS_RASTER_NEON
+            case PrefixKernel::eNeon:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    PrefixKernel bestPrefixKernel(){
+        static const PrefixKernel best=[]{
+            for(PrefixKernel kernel:{PrefixKernel::eAvx2,PrefixKernel::eNeon,PrefixKernel::eSse2}){
+                if(supportsPrefixKernel(kernel)) return kernel;
+            }
+            return PrefixKernel::eScalar;
+        }();
+        return best;
+    }
+
+    const char* prefixKernelName(PrefixKernel kernel){
+        switch(kernel){
+            case PrefixKernel::eScalar: return "scalar";
+            case PrefixKernel::eSse2: return "sse2";
+            case PrefixKernel::eAvx2: return "avx2";
+            case PrefixKernel::eNeon: return "neon";
+        }
+        return "unknown";
+    }
+
+    GlyphBitmap rasterize(
+        FT_Face face,
+        RasterBackend backend,
+        PrefixKernel kernel,
+        float tolerance
+    ){
+        FT_GlyphSlot slot=face->glyph;
+        if(slot->format!=FT_GLYPH_FORMAT_OUTLINE) throw std::runtime_error("Glyph is not an outline");
+        if(backend==RasterBackend::eAccumulation){
+            return accumulate(&slot->outline,kernel,tolerance);
+        }
+        FT_Error err=FT_Render_Glyph(slot,FT_RENDER_MODE_NORMAL);
+        if(err) throw std::runtime_error("Failed to render glyph");
+        return copyBitmap(slot);
+    }
+
+    std::vector<GlyphBitmap> rasterizeGlyphs(
+        FT_Face face,
+        const std::vector<FT_UInt>& glyphs,
+        RasterBackend backend,
+        PrefixKernel kernel,
+        float tolerance
+    ){
+        std::vector<GlyphBitmap> bitmaps(glyphs.size());
+        if(backend==RasterBackend::eFreeType){
+            for(size_t i=0;i<glyphs.size();i++){
+                FT_Error err=FT_Load_Glyph(face,glyphs[i],FT_LOAD_NO_BITMAP);
+                if(err) throw std::runtime_error("Failed to load glyph");
+                if(face->glyph->format!=FT_GLYPH_FORMAT_OUTLINE) continue;
+                bitmaps[i]=rasterize(face,backend,kernel,tolerance);
+            }
+            return bitmaps;
+        }
+
+        std::vector<GlyphPtr> outlines;
+        outlines.reserve(glyphs.size());
+        for(FT_UInt index:glyphs){
+            FT_Error err=FT_Load_Glyph(face,index,FT_LOAD_NO_BITMAP);
+            if(err) throw std::runtime_error("Failed to load glyph");
+            FT_Glyph glyph=nullptr;
+            if(face->glyph->format==FT_GLYPH_FORMAT_OUTLINE){
+                err=FT_Get_Glyph(face->glyph,&glyph);
+                if(err) throw std::runtime_error("Failed to copy glyph");
+            }
+            outlines.emplace_back(glyph,FT_Done_Glyph);
+        }
+        js::Scheduler::shared().parallelFor(0,outlines.size(),32,[&](size_t first,size_t last){
+            for(size_t i=first;i<last;i++){
+                if(!outlines[i]) continue;
+                auto* outlineGlyph=reinterpret_cast<FT_OutlineGlyph>(outlines[i].get());
+                bitmaps[i]=accumulate(&outlineGlyph->outline,kernel,tolerance);
+            }
+        });
+        return bitmaps;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "parser.hpp"
+#include <vector>
+#include <cstdint>
+
+enum class RasterBackend{
+    // FT_Render_Glyph with the gray rasterizer.
+    eFreeType,
+    // Flattened segments accumulated into a float buffer and resolved
+    // with a SIMD prefix sum.
+    eAccumulation
+};
+
+enum class PrefixKernel{
+    eScalar,
+    eSse2,
+    eAvx2,
+    eNeon
+};
+
+// 8-bit coverage, one byte per pixel and no row padding. left and top
+// follow FT_GlyphSlot's bitmap_left and bitmap_top.
+struct GlyphBitmap{
+    uint32_t width;
+    uint32_t height;
+    int32_t left;
+    int32_t top;
+    std::vector<uint8_t> pixels;
+};
+
+// Signed-area accumulation buffer. Every segment adds the area it
+// covers to the cell it crosses and the remainder to the next one, a
+// running sum along each row then yields the coverage. Contours must
+// be closed and inside [0,width]x[0,height].
+class Accumulator{
+public:
+    Accumulator(uint32_t width,uint32_t height);
+
+    void line(glm::vec2 p0,glm::vec2 p1);
+    void outline(const Outline& outline);
+    // Flattens a FreeType outline directly into the buffer, origin is
+    // the pixel position of the outline's (0,0).
+    void path(FT_Outline* outline,glm::vec2 origin,float tolerance);
+    // Prefix-sums the buffer into 8-bit coverage, width*height bytes.
+    void resolve(uint8_t* out,PrefixKernel kernel) const;
+
+private:
+    uint32_t width;
+    uint32_t height;
+    std::vector<float> cells;
+};
+
+namespace ps{
+    namespace utils{
+        // Widest kernel this CPU runs, detected once.
+        PrefixKernel bestPrefixKernel();
+        bool supportsPrefixKernel(PrefixKernel kernel);
+        const char* prefixKernelName(PrefixKernel kernel);
+
+        // Rasterizes the outline glyph loaded in face->glyph. The
+        // FreeType backend converts the slot to a bitmap in place.
+        GlyphBitmap rasterize(
+            FT_Face face,
+            RasterBackend backend,
+            PrefixKernel kernel=bestPrefixKernel(),
+            float tolerance=0.1f
+        );
+        // Rasterizes a batch of glyph indices at the face's current
+        // size. Loading stays serial since FT_Face is not thread-safe,
+        // the accumulation backend rasterizes on the shared scheduler.
+        std::vector<GlyphBitmap> rasterizeGlyphs(
+            FT_Face face,
+            const std::vector<FT_UInt>& glyphs,
+            RasterBackend backend,
+            PrefixKernel kernel=bestPrefixKernel(),
+            float tolerance=0.1f
+        );
+    };
+};
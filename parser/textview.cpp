@@ -0,0 +1,154 @@
+#include "textview.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& path){
+    file=CreateFileA(
+        path.c_str(),GENERIC_READ,FILE_SHARE_READ,nullptr,
+        OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,nullptr
+    );
+    if(file==INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open file: "+path);
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file,&fileSize);
+    length=static_cast<uint64_t>(fileSize.QuadPart);
+    if(length==0) return;
+    mapping=CreateFileMappingA(file,nullptr,PAGE_READONLY,0,0,nullptr);
+    if(!mapping) throw std::runtime_error("Failed to map file: "+path);
+    bytes=static_cast<const char*>(MapViewOfFile(mapping,FILE_MAP_READ,0,0,0));
+    if(!bytes) throw std::runtime_error("Failed to map file: "+path);
+}
+
+MappedFile::~MappedFile(){
+    if(bytes) UnmapViewOfFile(bytes);
+    if(mapping) CloseHandle(mapping);
+    if(file && file!=INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const std::string& path){
+    int fd=open(path.c_str(),O_RDONLY);
+    if(fd<0) throw std::runtime_error("Failed to open file: "+path);
+    struct stat info;
+    if(fstat(fd,&info)!=0){
+        close(fd);
+        throw std::runtime_error("Failed to stat file: "+path);
+    }
+    length=static_cast<uint64_t>(info.st_size);
+    if(length>0){
+        void* mapped=mmap(nullptr,length,PROT_READ,MAP_PRIVATE,fd,0);
+        if(mapped==MAP_FAILED){
+            close(fd);
+            throw std::runtime_error("Failed to map file: "+path);
+        }
+        bytes=static_cast<const char*>(mapped);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile(){
+    if(bytes) munmap(const_cast<char*>(bytes),length);
+}
+#endif
+
+TextView::TextView(
+    const std::string& path,
+    uint32_t checkpointInterval
+):file(path),interval(std::max(1u,checkpointInterval)){
+    checkpoints.push_back(0);
+    indexer=std::thread(&TextView::buildIndex,this);
+}
+
+TextView::~TextView(){
+    stop=true;
+    indexer.join();
+}
+
+uint64_t TextView::lineCount() const{
+    return lines.load(std::memory_order_acquire);
+}
+
+bool TextView::indexed() const{
+    return done.load(std::memory_order_acquire);
+}
+
+void TextView::buildIndex(){
+    const char* begin=file.data();
+    const char* end=begin+file.size();
+    const char* cursor=begin;
+    uint64_t count=0;
+    while(cursor<end && !stop.load(std::memory_order_relaxed)){
+        const char* newline=static_cast<const char*>(memchr(cursor,'\n',end-cursor));
+        if(!newline) break;
+        cursor=newline+1;
+        count++;
+        if(count%interval==0){
+            std::lock_guard<std::mutex> lock(indexMutex);
+            checkpoints.push_back(static_cast<uint64_t>(cursor-begin));
+            lines.store(count,std::memory_order_release);
+        }
+    }
+    // A last line without a trailing newline still counts.
+    if(cursor<end && !stop.load(std::memory_order_relaxed)) count++;
+    lines.store(count,std::memory_order_release);
+    done.store(true,std::memory_order_release);
+}
+
+uint64_t TextView::lineOffset(uint64_t line){
+    uint64_t fromLine;
+    uint64_t offset;
+    if(line>=cursorLine && line-cursorLine<interval){
+        fromLine=cursorLine;
+        offset=cursorOffset;
+    }else{
+        std::lock_guard<std::mutex> lock(indexMutex);
+        uint64_t checkpoint=std::min<uint64_t>(line/interval,checkpoints.size()-1);
+        fromLine=checkpoint*interval;
+        offset=checkpoints[checkpoint];
+    }
+    const char* begin=file.data();
+    for(;fromLine<line && offset<file.size();fromLine++){
+        const char* newline=static_cast<const char*>(memchr(begin+offset,'\n',file.size()-offset));
+        offset=newline?static_cast<uint64_t>(newline-begin)+1:file.size();
+    }
+    cursorLine=line;
+    cursorOffset=offset;
+    return offset;
+}
+
+std::string TextView::window(
+    uint64_t first,
+    uint32_t count,
+    uint32_t margin,
+    uint64_t& windowFirst,
+    uint32_t maxColumns
+){
+    uint64_t available=lineCount();
+    uint64_t start=first>margin?first-margin:0;
+    uint64_t end=std::min<uint64_t>(first+count+margin,available);
+    windowFirst=start;
+    std::string text;
+    if(start>=end) return text;
+
+    const char* begin=file.data();
+    uint64_t offset=lineOffset(start);
+    for(uint64_t line=start;line<end;line++){
+        const char* newline=static_cast<const char*>(memchr(begin+offset,'\n',file.size()-offset));
+        uint64_t lineEnd=newline?static_cast<uint64_t>(newline-begin):file.size();
+        uint64_t length=lineEnd-offset;
+        if(length>0 && begin[lineEnd-1]=='\r') length--;
+        if(line!=start) text.push_back('\n');
+        text.append(begin+offset,std::min<uint64_t>(length,maxColumns));
+        offset=std::min<uint64_t>(lineEnd+1,file.size());
+    }
+    return text;
+}
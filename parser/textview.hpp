@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Read-only mapping of a whole file, the OS pages it in on demand.
+class MappedFile{
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&)=delete;
+    MappedFile& operator=(const MappedFile&)=delete;
+
+    const char* data() const{ return bytes; }
+    uint64_t size() const{ return length; }
+
+private:
+    const char* bytes=nullptr;
+    uint64_t length=0;
+#ifdef _WIN32
+    void* file=nullptr;
+    void* mapping=nullptr;
+#endif
+};
+
+// Streams a text file of any size: the file is mapped rather than read,
+// and a background thread records the offset of every checkpointInterval-th
+// line, so the index costs 8 bytes per interval instead of per line.
+class TextView{
+public:
+    explicit TextView(
+        const std::string& path,
+        uint32_t checkpointInterval=1024
+    );
+    ~TextView();
+    TextView(const TextView&)=delete;
+    TextView& operator=(const TextView&)=delete;
+
+    // Lines indexed so far, grows until indexed() turns true.
+    uint64_t lineCount() const;
+    bool indexed() const;
+
+    // Returns lines [first-margin, first+count+margin) clipped to what
+    // is indexed, joined by '\n' and cut to maxColumns bytes each. The
+    // first returned line is reported through windowFirst.
+    std::string window(
+        uint64_t first,
+        uint32_t count,
+        uint32_t margin,
+        uint64_t& windowFirst,
+        uint32_t maxColumns=256
+    );
+
+private:
+    void buildIndex();
+    uint64_t lineOffset(uint64_t line);
+
+    MappedFile file;
+    uint32_t interval;
+    std::vector<uint64_t> checkpoints;
+    mutable std::mutex indexMutex;
+    std::atomic<uint64_t> lines{0};
+    std::atomic<bool> done{false};
+    std::atomic<bool> stop{false};
+    std::thread indexer;
+
+    // Last resolved line, sequential scrolling continues from here
+    // instead of rescanning from a checkpoint.
+    uint64_t cursorLine=0;
+    uint64_t cursorOffset=0;
+};
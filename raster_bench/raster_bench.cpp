@@ -0,0 +1,137 @@
+#include <parser/raster.hpp>
+#include "tools/cpp/runfiles/runfiles.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+
+using bazel::tools::cpp::runfiles::Runfiles;
+
+const uint32_t repetitions=3;
+
+// Best of a few runs, in milliseconds.
+static double measure(const std::function<void()>& fn){
+    double best=1e30;
+    for(uint32_t i=0;i<repetitions;i++){
+        auto start=std::chrono::steady_clock::now();
+        fn();
+        auto end=std::chrono::steady_clock::now();
+        best=std::min(best,std::chrono::duration<double,std::milli>(end-start).count());
+    }
+    return best;
+}
+
+struct Difference{
+    double mean;
+    uint32_t max;
+};
+
+// Compares two bitmaps placed by their left/top offsets, pixels
+// outside either one count as zero.
+static void compare(const GlyphBitmap& a,const GlyphBitmap& b,uint64_t& sum,uint64_t& count,uint32_t& max){
+    int32_t left=std::min(a.left,b.left);
+    int32_t top=std::max(a.top,b.top);
+    int32_t right=std::max(a.left+static_cast<int32_t>(a.width),b.left+static_cast<int32_t>(b.width));
+    int32_t bottom=std::min(a.top-static_cast<int32_t>(a.height),b.top-static_cast<int32_t>(b.height));
+    auto sample=[](const GlyphBitmap& bitmap,int32_t x,int32_t y)->int32_t{
+        int32_t column=x-bitmap.left;
+        int32_t row=bitmap.top-y;
+        if(column<0 || row<0 || column>=static_cast<int32_t>(bitmap.width) || row>=static_cast<int32_t>(bitmap.height)) return 0;
+        return bitmap.pixels[row*bitmap.width+column];
+    };
+    for(int32_t y=top;y>bottom;y--){
+        for(int32_t x=left;x<right;x++){
+            uint32_t difference=std::abs(sample(a,x,y)-sample(b,x,y));
+            sum+=difference;
+            max=std::max(max,difference);
+            count++;
+        }
+    }
+}
+
+static Difference difference(const std::vector<GlyphBitmap>& a,const std::vector<GlyphBitmap>& b){
+    uint64_t sum=0;
+    uint64_t count=0;
+    uint32_t max=0;
+    for(size_t i=0;i<a.size();i++) compare(a[i],b[i],sum,count,max);
+    return {count?static_cast<double>(sum)/count:0.0,max};
+}
+
+static void row(const std::string& name,double ms,double baseline,size_t glyphs){
+    std::cout<<"  "<<std::left<<std::setw(22)<<name<<std::right
+             <<std::setw(9)<<ms<<" ms "
+             <<std::setw(10)<<glyphs/(ms/1000.0)<<" glyphs/s "
+             <<std::setw(6)<<baseline/ms<<"x\n";
+}
+
+// Rasterizes every glyph of the font at a few sizes with FreeType's
+// gray rasterizer and with the accumulation backend on each prefix
+// kernel this CPU supports. Times include loading the glyph, the
+// load-only time is printed for reference.
+int main(int argc,char** argv){
+    std::string fontPath;
+    if(argc>1){
+        fontPath=argv[1];
+    }else{
+        std::string error;
+        std::unique_ptr<Runfiles> runfiles(Runfiles::Create(argv[0],&error));
+        if(!runfiles){
+            std::cerr<<"Pass a font path: "<<error<<"\n";
+            return 1;
+        }
+        fontPath=runfiles->Rlocation("_main/example_bin/data/Roboto-Black.ttf");
+    }
+
+    FT_Library library=ps::create::library();
+    FT_Face face=ps::create::face(library,fontPath,16);
+    std::vector<FT_UInt> glyphs(face->num_glyphs);
+    std::iota(glyphs.begin(),glyphs.end(),0);
+    std::cout<<std::fixed<<std::setprecision(2)
+             <<fontPath<<": "<<glyphs.size()<<" glyphs, best of "<<repetitions<<"\n";
+
+    for(uint32_t size:{16u,48u,128u}){
+        FT_Error err=FT_Set_Pixel_Sizes(face,0,size);
+        if(err) throw std::runtime_error("Failed to set pixel size");
+        std::cout<<size<<"px\n";
+
+        double load=measure([&]{
+            for(FT_UInt glyph:glyphs) FT_Load_Glyph(face,glyph,FT_LOAD_NO_BITMAP);
+        });
+        std::cout<<"  "<<std::left<<std::setw(22)<<"load only"<<std::right
+                 <<std::setw(9)<<load<<" ms\n";
+
+        std::vector<GlyphBitmap> reference;
+        double freetype=measure([&]{
+            reference=ps::utils::rasterizeGlyphs(face,glyphs,RasterBackend::eFreeType);
+        });
+        row("freetype",freetype,freetype,glyphs.size());
+
+        for(PrefixKernel kernel:{PrefixKernel::eScalar,PrefixKernel::eSse2,PrefixKernel::eAvx2,PrefixKernel::eNeon}){
+            if(!ps::utils::supportsPrefixKernel(kernel)) continue;
+            std::vector<GlyphBitmap> bitmaps(glyphs.size());
+            double ms=measure([&]{
+                for(size_t i=0;i<glyphs.size();i++){
+                    FT_Load_Glyph(face,glyphs[i],FT_LOAD_NO_BITMAP);
+                    if(face->glyph->format!=FT_GLYPH_FORMAT_OUTLINE) continue;
+                    bitmaps[i]=ps::utils::rasterize(face,RasterBackend::eAccumulation,kernel);
+                }
+            });
+            Difference diff=difference(reference,bitmaps);
+            row(std::string("accumulation ")+ps::utils::prefixKernelName(kernel),ms,freetype,glyphs.size());
+            std::cout<<"    vs freetype: mean |diff| "<<diff.mean<<", max "<<diff.max<<"\n";
+        }
+
+        double batch=measure([&]{
+            ps::utils::rasterizeGlyphs(face,glyphs,RasterBackend::eAccumulation);
+        });
+        row("accumulation batch",batch,freetype,glyphs.size());
+    }
+
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+}
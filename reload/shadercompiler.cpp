@@ -0,0 +1,123 @@
+#include "shadercompiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#ifdef _WIN32
+#include <process.h>
+#define popen _popen
+#define pclose _pclose
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace{
+    std::string quote(const std::string& text){
+        return "\""+text+"\"";
+    }
+
+    // Other instances of the app and other shaders with the same stem
+    // compile into the same temp directory.
+    std::filesystem::path uniqueOutput(const std::string& name){
+        static std::atomic<uint64_t> counter{0};
+        std::string file=name+"."+std::to_string(getpid())+"."+std::to_string(counter++)+".spv";
+        return std::filesystem::temp_directory_path()/file;
+    }
+}
+
+ShaderCompiler::ShaderCompiler(
+    std::string compiler
+):compiler(std::move(compiler)){
+    worker=std::thread(&ShaderCompiler::run,this);
+}
+
+ShaderCompiler::~ShaderCompiler(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop=true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+std::string ShaderCompiler::defaultCompiler(){
+    const char* sdk=std::getenv("VULKAN_SDK");
+    if(!sdk) return "glslc";
+#ifdef _WIN32
+    return (std::filesystem::path(sdk)/"Bin"/"glslc.exe").string();
+#else
+    return (std::filesystem::path(sdk)/"bin"/"glslc").string();
+#endif
+}
+
+void ShaderCompiler::compile(const std::string& source){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(std::find(queue.begin(),queue.end(),source)!=queue.end()) return;
+        queue.push_back(source);
+    }
+    wake.notify_one();
+}
+
+std::vector<CompiledShader> ShaderCompiler::poll(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::exchange(done,{});
+}
+
+void ShaderCompiler::run(){
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true){
+        wake.wait(lock,[this]{ return stop || !queue.empty(); });
+        if(stop) return;
+        std::string source=std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        CompiledShader shader=build(source);
+        lock.lock();
+        done.push_back(std::move(shader));
+    }
+}
+
+CompiledShader ShaderCompiler::build(const std::string& source) const{
+    CompiledShader result{source,false,{},{}};
+    // shader.vert and shader.frag must not share an output.
+    std::string name=std::filesystem::path(source).filename().string();
+    std::replace(name.begin(),name.end(),'.','_');
+    std::filesystem::path output=uniqueOutput(name);
+
+    std::string command=quote(compiler)+" "+quote(source)+" -o "+quote(output.string())+" 2>&1";
+#ifdef _WIN32
+    // cmd strips the outer pair of quotes from the whole line.
+    command=quote(command);
+#endif
+    FILE* pipe=popen(command.c_str(),"r");
+    if(!pipe){
+        result.log="Failed to run "+compiler;
+        return result;
+    }
+    char buffer[512];
+    size_t read;
+    while((read=std::fread(buffer,1,sizeof(buffer),pipe))>0) result.log.append(buffer,read);
+    int status=pclose(pipe);
+    std::error_code ignored;
+    if(status!=0){
+        std::filesystem::remove(output,ignored);
+        if(result.log.empty()) result.log=compiler+" failed";
+        return result;
+    }
+
+    {
+        std::ifstream file(output,std::ios::binary);
+        result.code.assign(std::istreambuf_iterator<char>(file),std::istreambuf_iterator<char>());
+    }
+    std::filesystem::remove(output,ignored);
+    result.ok=!result.code.empty();
+    if(!result.ok) result.log="No SPIR-V written to "+output.string();
+    return result;
+}
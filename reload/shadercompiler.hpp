@@ -0,0 +1,48 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct CompiledShader{
+    // The path passed to compile().
+    std::string source;
+    bool ok;
+    std::vector<char> code;
+    // glslc's output, holds the errors when ok is false.
+    std::string log;
+};
+
+// Runs glslc on a background thread so editing a shader never stalls
+// the frame loop. SPIR-V goes to a uniquely named file in the temp
+// directory that is removed once read back, the .spv files shipped
+// next to the sources are left alone.
+class ShaderCompiler{
+public:
+    explicit ShaderCompiler(std::string compiler=defaultCompiler());
+    ~ShaderCompiler();
+    ShaderCompiler(const ShaderCompiler&)=delete;
+    ShaderCompiler& operator=(const ShaderCompiler&)=delete;
+
+    // glslc from $VULKAN_SDK when set, otherwise from PATH.
+    static std::string defaultCompiler();
+
+    // Queues source, a source already waiting is compiled only once.
+    void compile(const std::string& source);
+    // Shaders finished since the last call.
+    std::vector<CompiledShader> poll();
+
+private:
+    void run();
+    CompiledShader build(const std::string& source) const;
+
+    std::string compiler;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::string> queue;
+    std::vector<CompiledShader> done;
+    bool stop=false;
+    std::thread worker;
+};
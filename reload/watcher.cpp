@@ -0,0 +1,110 @@
+#include "watcher.hpp"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FileWatcher::FileWatcher(
+    const std::vector<std::string>& paths,
+    std::chrono::milliseconds settle
+):paths(paths),settle(settle),watches(paths.size(),-1),changedAt(paths.size()){
+    for(const std::string& path:paths){
+        std::error_code error;
+        std::filesystem::path canonical=std::filesystem::canonical(path,error);
+        resolved.push_back(error?std::filesystem::path(path):canonical);
+    }
+#ifdef __linux__
+    inotifyFd=inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotifyFd>=0){
+        // Files are replaced as often as they are rewritten, so the
+        // directory is watched rather than the file itself.
+        for(size_t i=0;i<resolved.size();i++){
+            watches[i]=inotify_add_watch(
+                inotifyFd,
+                resolved[i].parent_path().c_str(),
+                IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE
+            );
+            if(watches[i]<0){
+                close(inotifyFd);
+                inotifyFd=-1;
+                break;
+            }
+        }
+    }
+#endif
+    watcher=std::thread(&FileWatcher::run,this);
+}
+
+FileWatcher::~FileWatcher(){
+    stop=true;
+    watcher.join();
+#ifdef __linux__
+    if(inotifyFd>=0) close(inotifyFd);
+#endif
+}
+
+std::vector<std::string> FileWatcher::poll(){
+    std::vector<std::string> changed;
+    Clock::time_point now=Clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    for(size_t i=0;i<paths.size();i++){
+        if(changedAt[i]==Clock::time_point{} || now-changedAt[i]<settle) continue;
+        changedAt[i]=Clock::time_point{};
+        changed.push_back(paths[i]);
+    }
+    return changed;
+}
+
+void FileWatcher::touched(size_t file){
+    std::lock_guard<std::mutex> lock(mutex);
+    changedAt[file]=Clock::now();
+}
+
+void FileWatcher::run(){
+    if(native()) runInotify();
+    else runPolling();
+}
+
+void FileWatcher::runInotify(){
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    while(!stop){
+        // Woken up regularly to notice stop.
+        pollfd fd{inotifyFd,POLLIN,0};
+        if(::poll(&fd,1,static_cast<int>(pollInterval.count()))<=0) continue;
+        ssize_t length;
+        while((length=read(inotifyFd,buffer,sizeof(buffer)))>0){
+            for(char* at=buffer;at<buffer+length;){
+                const inotify_event* event=reinterpret_cast<const inotify_event*>(at);
+                at+=sizeof(inotify_event)+event->len;
+                if(event->len==0) continue;
+                for(size_t i=0;i<resolved.size();i++){
+                    if(watches[i]==event->wd && resolved[i].filename()==event->name) touched(i);
+                }
+            }
+        }
+    }
+#endif
+}
+
+void FileWatcher::runPolling(){
+    std::vector<std::filesystem::file_time_type> times(resolved.size());
+    for(size_t i=0;i<resolved.size();i++){
+        std::error_code error;
+        times[i]=std::filesystem::last_write_time(resolved[i],error);
+    }
+    while(!stop){
+        std::this_thread::sleep_for(pollInterval);
+        for(size_t i=0;i<resolved.size();i++){
+            // A file missing in the middle of a save is picked up on a
+            // later pass once it is back.
+            std::error_code error;
+            auto time=std::filesystem::last_write_time(resolved[i],error);
+            if(error || time==times[i]) continue;
+            times[i]=time;
+            touched(i);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reports files that changed on disk. On Linux the directories holding
+// the files are watched with inotify, which also catches editors that
+// save by renaming a temporary file over the original; elsewhere, or
+// when inotify is unavailable, modification times are polled.
+//
+// Paths are resolved through symlinks first, so files reached through
+// Bazel runfiles are watched where they are actually edited. A file
+// is only reported once it has been quiet for the settle time, one
+// save that writes it several times yields a single change.
+class FileWatcher{
+public:
+    using Clock=std::chrono::steady_clock;
+
+    explicit FileWatcher(
+        const std::vector<std::string>& paths,
+        std::chrono::milliseconds settle=std::chrono::milliseconds(50)
+    );
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&)=delete;
+    FileWatcher& operator=(const FileWatcher&)=delete;
+
+    // Changed files since the last call, as passed to the constructor.
+    std::vector<std::string> poll();
+    // False when the polling fallback is in use.
+    bool native() const{ return inotifyFd>=0; }
+
+private:
+    static constexpr auto pollInterval=std::chrono::milliseconds(250);
+
+    void run();
+    void runInotify();
+    void runPolling();
+    void touched(size_t file);
+
+    std::vector<std::string> paths;
+    std::vector<std::filesystem::path> resolved;
+    std::chrono::milliseconds settle;
+    int inotifyFd=-1;
+    // Inotify watch descriptor of each file's directory.
+    std::vector<int> watches;
+
+    std::mutex mutex;
+    // Time of the latest change per file, zero when none is pending.
+    std::vector<Clock::time_point> changedAt;
+    std::atomic<bool> stop{false};
+    std::thread watcher;
+};
@@ -0,0 +1,250 @@
+#include "allocator.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <iomanip>
+#include <ostream>
+
+namespace{
+    const size_t arenaBlockSize=64*1024;
+    const size_t smallestClass=64;
+
+    struct ArenaBlock{
+        // One reference per live allocation plus one held by the owning
+        // thread while the block is its current one.
+        std::atomic<uint32_t> live;
+        size_t offset;
+    };
+
+    struct Header{
+        void* raw;
+        ArenaBlock* block;
+        size_t size;
+        uint32_t scope;
+        uint32_t sizeClass;
+    };
+
+    char* blockData(ArenaBlock* block){
+        return reinterpret_cast<char*>(block)+sizeof(ArenaBlock);
+    }
+
+    void dropBlock(ArenaBlock* block){
+        if(block->live.fetch_sub(1,std::memory_order_acq_rel)==1){
+            block->~ArenaBlock();
+            std::free(block);
+        }
+    }
+
+    struct ThreadArena{
+        ArenaBlock* current=nullptr;
+        ~ThreadArena(){
+            if(current) dropBlock(current);
+        }
+    };
+
+    thread_local ThreadArena threadArena;
+
+    char* alignUp(char* p,size_t alignment){
+        uintptr_t value=reinterpret_cast<uintptr_t>(p);
+        return reinterpret_cast<char*>((value+alignment-1)&~(uintptr_t)(alignment-1));
+    }
+
+    // Returns null when the request is too large for an arena block.
+    void* arenaAllocate(size_t size,size_t alignment){
+        size_t capacity=arenaBlockSize-sizeof(ArenaBlock);
+        if(size+sizeof(Header)+alignment>capacity/2) return nullptr;
+
+        ArenaBlock*& block=threadArena.current;
+        // Only our own reference is left, every allocation in it is gone.
+        if(block && block->live.load(std::memory_order_acquire)==1) block->offset=0;
+
+        char* user=nullptr;
+        if(block){
+            user=alignUp(blockData(block)+block->offset+sizeof(Header),alignment);
+            if(user+size>blockData(block)+capacity){
+                dropBlock(block);
+                block=nullptr;
+            }
+        }
+        if(!block){
+            void* memory=std::malloc(arenaBlockSize);
+            if(!memory) return nullptr;
+            block=new(memory) ArenaBlock{};
+            block->live.store(1,std::memory_order_relaxed);
+            block->offset=0;
+            user=alignUp(blockData(block)+sizeof(Header),alignment);
+        }
+        block->offset=static_cast<size_t>(user+size-blockData(block));
+        block->live.fetch_add(1,std::memory_order_relaxed);
+
+        Header* header=reinterpret_cast<Header*>(user)-1;
+        header->raw=nullptr;
+        header->block=block;
+        return user;
+    }
+
+    const char* scopeName(size_t scope){
+        switch(scope){
+            case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "command";
+            case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "object";
+            case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "cache";
+            case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "device";
+            case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "instance";
+        }
+        return "unknown";
+    }
+}
+
+HostAllocator::HostAllocator(uint64_t byteLimit):limit(byteLimit){
+    vkCallbacks=vk::AllocationCallbacks(
+        this,
+        onAllocation,
+        onReallocation,
+        onFree,
+        onInternalAllocation,
+        onInternalFree
+    );
+}
+
+HostAllocator::~HostAllocator(){
+    for(SizeClass& sizeClass:classes){
+        for(void* raw:sizeClass.free) std::free(raw);
+    }
+}
+
+uint64_t HostAllocator::bytes(vk::SystemAllocationScope scope) const{
+    return stats[static_cast<size_t>(scope)].bytes.load(std::memory_order_relaxed);
+}
+
+uint64_t HostAllocator::allocations(vk::SystemAllocationScope scope) const{
+    return stats[static_cast<size_t>(scope)].total.load(std::memory_order_relaxed);
+}
+
+uint64_t HostAllocator::totalBytes() const{
+    return used.load(std::memory_order_relaxed);
+}
+
+uint64_t HostAllocator::internalBytes() const{
+    return internal.load(std::memory_order_relaxed);
+}
+
+void HostAllocator::report(std::ostream& out) const{
+    out<<"host allocations: "<<totalBytes()<<" bytes live, "
+       <<internalBytes()<<" bytes internal\n";
+    for(size_t scope=0;scope<scopeCount;scope++){
+        out<<"  "<<std::left<<std::setw(9)<<scopeName(scope)<<std::right
+           <<std::setw(10)<<stats[scope].bytes.load()<<" bytes "
+           <<std::setw(6)<<stats[scope].live.load()<<" live "
+           <<std::setw(8)<<stats[scope].total.load()<<" total\n";
+    }
+}
+
+void* HostAllocator::poolAllocate(size_t size,size_t alignment){
+    size_t needed=size+sizeof(Header)+alignment;
+    uint32_t sizeClass=0;
+    while(sizeClass<classCount && (smallestClass<<sizeClass)<needed) sizeClass++;
+
+    void* raw=nullptr;
+    if(sizeClass<classCount){
+        SizeClass& bucket=classes[sizeClass];
+        {
+            std::lock_guard<std::mutex> lock(bucket.mutex);
+            if(!bucket.free.empty()){
+                raw=bucket.free.back();
+                bucket.free.pop_back();
+            }
+        }
+        if(!raw) raw=std::malloc(smallestClass<<sizeClass);
+    }else{
+        raw=std::malloc(needed);
+    }
+    if(!raw) return nullptr;
+
+    char* user=alignUp(static_cast<char*>(raw)+sizeof(Header),alignment);
+    Header* header=reinterpret_cast<Header*>(user)-1;
+    header->raw=raw;
+    header->block=nullptr;
+    header->sizeClass=sizeClass;
+    return user;
+}
+
+void* HostAllocator::allocate(size_t size,size_t alignment,VkSystemAllocationScope scope){
+    if(size==0) return nullptr;
+    if(limit && used.fetch_add(size,std::memory_order_relaxed)+size>limit){
+        used.fetch_sub(size,std::memory_order_relaxed);
+        return nullptr;
+    }else if(!limit){
+        used.fetch_add(size,std::memory_order_relaxed);
+    }
+    alignment=std::max(alignment,alignof(Header));
+
+    void* user=nullptr;
+    if(scope==VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) user=arenaAllocate(size,alignment);
+    if(!user) user=poolAllocate(size,alignment);
+    if(!user){
+        used.fetch_sub(size,std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Header* header=static_cast<Header*>(user)-1;
+    header->size=size;
+    header->scope=static_cast<uint32_t>(scope);
+    ScopeStats& scopeStats=stats[scope];
+    scopeStats.bytes.fetch_add(size,std::memory_order_relaxed);
+    scopeStats.live.fetch_add(1,std::memory_order_relaxed);
+    scopeStats.total.fetch_add(1,std::memory_order_relaxed);
+    return user;
+}
+
+void* HostAllocator::reallocate(void* original,size_t size,size_t alignment,VkSystemAllocationScope scope){
+    if(!original) return allocate(size,alignment,scope);
+    if(size==0){
+        release(original);
+        return nullptr;
+    }
+    void* memory=allocate(size,alignment,scope);
+    if(!memory) return nullptr;
+    Header* header=static_cast<Header*>(original)-1;
+    std::memcpy(memory,original,std::min(size,header->size));
+    release(original);
+    return memory;
+}
+
+void HostAllocator::release(void* memory){
+    if(!memory) return;
+    Header* header=static_cast<Header*>(memory)-1;
+    ScopeStats& scopeStats=stats[header->scope];
+    scopeStats.bytes.fetch_sub(header->size,std::memory_order_relaxed);
+    scopeStats.live.fetch_sub(1,std::memory_order_relaxed);
+    used.fetch_sub(header->size,std::memory_order_relaxed);
+
+    if(header->block){
+        dropBlock(header->block);
+    }else if(header->sizeClass<classCount){
+        SizeClass& bucket=classes[header->sizeClass];
+        std::lock_guard<std::mutex> lock(bucket.mutex);
+        bucket.free.push_back(header->raw);
+    }else{
+        std::free(header->raw);
+    }
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostAllocator::onAllocation(void* userData,size_t size,size_t alignment,VkSystemAllocationScope scope){
+    return static_cast<HostAllocator*>(userData)->allocate(size,alignment,scope);
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostAllocator::onReallocation(void* userData,void* original,size_t size,size_t alignment,VkSystemAllocationScope scope){
+    return static_cast<HostAllocator*>(userData)->reallocate(original,size,alignment,scope);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::onFree(void* userData,void* memory){
+    static_cast<HostAllocator*>(userData)->release(memory);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::onInternalAllocation(void* userData,size_t size,VkInternalAllocationType type,VkSystemAllocationScope scope){
+    static_cast<HostAllocator*>(userData)->internal.fetch_add(size,std::memory_order_relaxed);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::onInternalFree(void* userData,size_t size,VkInternalAllocationType type,VkSystemAllocationScope scope){
+    static_cast<HostAllocator*>(userData)->internal.fetch_sub(size,std::memory_order_relaxed);
+}
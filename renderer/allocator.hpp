@@ -0,0 +1,63 @@
+#pragma once
+#include <vulkan/vulkan_raii.hpp>
+#include <array>
+#include <atomic>
+#include <iosfwd>
+#include <mutex>
+#include <vector>
+
+struct ScopeStats{
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> live{0};
+    std::atomic<uint64_t> total{0};
+};
+
+// Host allocator handed to the driver through VkAllocationCallbacks.
+// Command-scope allocations, which only live for one API call, are
+// bump-allocated from a per-thread arena so recording threads never
+// contend on malloc; everything else goes to a size-class pool. Bytes
+// and allocation counts are tracked per VkSystemAllocationScope and an
+// optional limit makes the driver see VK_ERROR_OUT_OF_HOST_MEMORY.
+class HostAllocator{
+public:
+    explicit HostAllocator(uint64_t byteLimit=0);
+    ~HostAllocator();
+    HostAllocator(const HostAllocator&)=delete;
+    HostAllocator& operator=(const HostAllocator&)=delete;
+
+    const vk::AllocationCallbacks& callbacks() const{ return vkCallbacks; }
+
+    uint64_t bytes(vk::SystemAllocationScope scope) const;
+    uint64_t allocations(vk::SystemAllocationScope scope) const;
+    uint64_t totalBytes() const;
+    // Memory the driver allocated itself and only reported to us.
+    uint64_t internalBytes() const;
+    void report(std::ostream& out) const;
+
+private:
+    static constexpr size_t scopeCount=VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE+1;
+    static constexpr size_t classCount=12;
+
+    void* allocate(size_t size,size_t alignment,VkSystemAllocationScope scope);
+    void* reallocate(void* original,size_t size,size_t alignment,VkSystemAllocationScope scope);
+    void release(void* memory);
+    void* poolAllocate(size_t size,size_t alignment);
+
+    static VKAPI_ATTR void* VKAPI_CALL onAllocation(void* userData,size_t size,size_t alignment,VkSystemAllocationScope scope);
+    static VKAPI_ATTR void* VKAPI_CALL onReallocation(void* userData,void* original,size_t size,size_t alignment,VkSystemAllocationScope scope);
+    static VKAPI_ATTR void VKAPI_CALL onFree(void* userData,void* memory);
+    static VKAPI_ATTR void VKAPI_CALL onInternalAllocation(void* userData,size_t size,VkInternalAllocationType type,VkSystemAllocationScope scope);
+    static VKAPI_ATTR void VKAPI_CALL onInternalFree(void* userData,size_t size,VkInternalAllocationType type,VkSystemAllocationScope scope);
+
+    vk::AllocationCallbacks vkCallbacks;
+    uint64_t limit;
+    std::atomic<uint64_t> used{0};
+    std::atomic<uint64_t> internal{0};
+    std::array<ScopeStats,scopeCount> stats;
+
+    struct SizeClass{
+        std::mutex mutex;
+        std::vector<void*> free;
+    };
+    std::array<SizeClass,classCount> classes;
+};
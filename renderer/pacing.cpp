@@ -0,0 +1,141 @@
+#include "pacing.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+
+namespace{
+    // Plain sleeps are only trusted up to this close to a deadline.
+    const auto spinWindow=std::chrono::milliseconds(2);
+    // Head start on the predicted work so a slightly slower frame still
+    // makes its slot.
+    const auto latencySlack=std::chrono::microseconds(1000);
+
+    double toMs(std::chrono::steady_clock::duration duration){
+        return std::chrono::duration<double,std::milli>(duration).count();
+    }
+}
+
+FramePacer::FramePacer(
+    PacingMode mode,
+    double refreshRate,
+    double targetFps
+):pacingMode(mode){
+    if(refreshRate<=0.0) refreshRate=60.0;
+    if(targetFps<=0.0) targetFps=30.0;
+    double rate=mode==PacingMode::ePowerSaving?targetFps:refreshRate;
+    interval=mode==PacingMode::eThroughput?
+        Clock::duration::zero():
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0/rate));
+    history.reserve(historySize);
+}
+
+std::vector<vk::PresentModeKHR> FramePacer::presentModes(PacingMode mode){
+    switch(mode){
+        case PacingMode::eThroughput:
+            return {vk::PresentModeKHR::eMailbox,vk::PresentModeKHR::eImmediate,vk::PresentModeKHR::eFifo};
+        case PacingMode::eLowLatency:
+            // Mailbox always shows the newest frame and never blocks the
+            // pacer, immediate trades tearing for the same.
+            return {vk::PresentModeKHR::eMailbox,vk::PresentModeKHR::eImmediate,vk::PresentModeKHR::eFifo};
+        case PacingMode::ePowerSaving:
+            return {vk::PresentModeKHR::eFifo};
+    }
+    return {vk::PresentModeKHR::eFifo};
+}
+
+PacingMode FramePacer::parseMode(const std::string& name){
+    if(name=="throughput") return PacingMode::eThroughput;
+    if(name=="low-latency") return PacingMode::eLowLatency;
+    if(name=="power-saving") return PacingMode::ePowerSaving;
+    throw std::runtime_error("Unknown pacing mode: "+name);
+}
+
+const char* FramePacer::modeName(PacingMode mode){
+    switch(mode){
+        case PacingMode::eThroughput: return "throughput";
+        case PacingMode::eLowLatency: return "low-latency";
+        case PacingMode::ePowerSaving: return "power-saving";
+    }
+    return "unknown";
+}
+
+void FramePacer::spinUntil(Clock::time_point deadline){
+    if(Clock::now()+spinWindow<deadline) std::this_thread::sleep_until(deadline-spinWindow);
+    while(Clock::now()<deadline) std::this_thread::yield();
+}
+
+void FramePacer::waitForFrame(){
+    if(started){
+        switch(pacingMode){
+            case PacingMode::eThroughput:
+                break;
+            case PacingMode::eLowLatency:
+                // Wake up just early enough for the present to make its
+                // slot on the refresh-rate grid.
+                spinUntil(nextPresent-predictedWork-latencySlack);
+                break;
+            case PacingMode::ePowerSaving:
+                // Waking a little late only stretches one frame, not
+                // worth spinning for.
+                std::this_thread::sleep_until(frameStart+interval);
+                break;
+        }
+    }
+    frameStart=Clock::now();
+    inputTime=frameStart;
+}
+
+void FramePacer::inputPolled(){
+    inputTime=Clock::now();
+}
+
+void FramePacer::presented(){
+    Clock::time_point now=Clock::now();
+    Clock::duration work=now-frameStart;
+    // Grow at once on a slow frame, shrink slowly after it.
+    if(work>predictedWork) predictedWork=work;
+    else predictedWork=predictedWork-(predictedWork-work)/10;
+
+    if(!started) firstPresent=now;
+    started=true;
+    // Presents are kept on a fixed grid; after a missed slot the grid
+    // restarts from this present instead of trying to catch up.
+    nextPresent+=interval;
+    if(nextPresent<=now) nextPresent=now+interval;
+    lastPresent=now;
+
+    double latency=toMs(now-inputTime);
+    if(history.size()<historySize) history.push_back(latency);
+    else history[historyNext]=latency;
+    historyNext=(historyNext+1)%historySize;
+    frameCount++;
+    latencySum+=latency;
+    latencyMax=std::max(latencyMax,latency);
+}
+
+LatencyStats FramePacer::stats() const{
+    LatencyStats result{frameCount,0.0,0.0,0.0,latencyMax,0.0};
+    if(frameCount==0) return result;
+    result.averageMs=latencySum/frameCount;
+
+    // Percentiles cover the most recent historySize frames.
+    std::vector<double> sorted=history;
+    std::sort(sorted.begin(),sorted.end());
+    result.p50Ms=sorted[sorted.size()/2];
+    result.p99Ms=sorted[std::min(sorted.size()-1,sorted.size()*99/100)];
+
+    double seconds=toMs(lastPresent-firstPresent)/1000.0;
+    if(frameCount>1 && seconds>0.0) result.fps=(frameCount-1)/seconds;
+    return result;
+}
+
+void FramePacer::report(std::ostream& out) const{
+    LatencyStats s=stats();
+    out<<std::fixed<<std::setprecision(2)
+       <<"pacing "<<modeName(pacingMode)<<": "<<s.frames<<" frames, "
+       <<s.fps<<" fps, input to present avg "<<s.averageMs<<" ms, p50 "
+       <<s.p50Ms<<" ms, p99 "<<s.p99Ms<<" ms, max "<<s.maxMs<<" ms\n"
+       <<std::defaultfloat;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <vulkan/vulkan_raii.hpp>
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+enum class PacingMode{
+    // Render as fast as the swapchain accepts frames.
+    eThroughput,
+    // Cap to the refresh rate and start each frame as late as the
+    // measured frame time allows, so input is latched right before
+    // recording.
+    eLowLatency,
+    // Cap to a target frame rate and sleep in between.
+    ePowerSaving
+};
+
+struct LatencyStats{
+    uint64_t frames;
+    double averageMs;
+    double p50Ms;
+    double p99Ms;
+    double maxMs;
+    double fps;
+};
+
+// Decides when the frame loop may start the next frame and measures
+// the time from polling input to handing the frame to present.
+//
+// Per frame the loop calls waitForFrame(), waits for the frame fence,
+// polls events, calls inputPolled(), records and presents, then calls
+// presented().
+class FramePacer{
+public:
+    using Clock=std::chrono::steady_clock;
+
+    FramePacer(PacingMode mode,double refreshRate,double targetFps=30.0);
+
+    // Present modes in order of preference for mode, FIFO is always
+    // last since it is the only one every surface supports.
+    static std::vector<vk::PresentModeKHR> presentModes(PacingMode mode);
+    static PacingMode parseMode(const std::string& name);
+    static const char* modeName(PacingMode mode);
+
+    PacingMode mode() const{ return pacingMode; }
+    void waitForFrame();
+    void inputPolled();
+    void presented();
+
+    LatencyStats stats() const;
+    void report(std::ostream& out) const;
+
+private:
+    static constexpr size_t historySize=512;
+
+    // Sleeps most of the way and yields for the last stretch, plain
+    // sleeps overshoot by up to a scheduler tick. Only for low-latency,
+    // the spin costs a core for its last couple of milliseconds.
+    static void spinUntil(Clock::time_point deadline);
+
+    PacingMode pacingMode;
+    Clock::duration interval;
+    // Running estimate of wake-up to present, the low-latency mode
+    // wakes up this long before the next frame is due.
+    Clock::duration predictedWork{};
+    Clock::time_point frameStart;
+    Clock::time_point inputTime;
+    Clock::time_point lastPresent;
+    // Where the low-latency mode wants the next present to land.
+    Clock::time_point nextPresent;
+    Clock::time_point firstPresent;
+    bool started=false;
+
+    std::vector<double> history;
+    size_t historyNext=0;
+    uint64_t frameCount=0;
+    double latencySum=0.0;
+    double latencyMax=0.0;
+};
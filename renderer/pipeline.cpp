@@ -1,5 +1,8 @@
 #include "pipeline.hpp"
+#include "validation.hpp"
+#include <algorithm>
 #include <cstddef>
+#include <tuple>
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -9,34 +12,24 @@ const bool enableValidationLayers = true;
 
 const uint64_t FenceTimeout = 100000000;
 bool framebufferResized=false;
+// Must match local_size_x in cull.comp.
+const uint32_t cullGroupSize=64;
 
-static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
-    std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
-    return VK_FALSE;
-}
-
-VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
-    auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-    if (func != nullptr) {
-        return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
-    } else {
-        return VK_ERROR_EXTENSION_NOT_PRESENT;
-    }
-}
-
-void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator) {
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-    if (func != nullptr) {
-        func(instance, debugMessenger, pAllocator);
-    }
-}
+// Push constants of cull.comp.
+struct CullConstants{
+    glm::vec4 viewport;
+    uint32_t runCount;
+};
 
+// Every severity and type is requested, ValidationLog::shared()
+// applies its own runtime filters.
 void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
     createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-    createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
     createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-    createInfo.pfnUserCallback = debugCallback;
+    createInfo.pfnUserCallback = ValidationLog::callback;
+    createInfo.pUserData = &ValidationLog::shared();
 }
 
 static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
@@ -66,6 +59,29 @@ std::array<vk::VertexInputAttributeDescription,2> Vertex::getAttributeDescriptio
     return attributeDescription;
 }
 
+vk::VertexInputBindingDescription CurveVertex::getBindingDescription(){
+    vk::VertexInputBindingDescription binding(
+        0,sizeof(CurveVertex),
+        vk::VertexInputRate::eVertex
+    );
+    return binding;
+}
+
+std::array<vk::VertexInputAttributeDescription,2> CurveVertex::getAttributeDescription(){
+    std::array<vk::VertexInputAttributeDescription,2> attributeDescription;
+    attributeDescription[0].setBinding(0);
+    attributeDescription[0].setLocation(0);
+    attributeDescription[0].setFormat(vk::Format::eR32G32Sfloat);
+    attributeDescription[0].setOffset(offsetof(CurveVertex, pos));
+
+    attributeDescription[1].setBinding(0);
+    attributeDescription[1].setLocation(1);
+    attributeDescription[1].setFormat(vk::Format::eR32G32Sfloat);
+    attributeDescription[1].setOffset(offsetof(CurveVertex, uv));
+
+    return attributeDescription;
+}
+
 namespace vo::create{
     GLFWwindow* window(
             int width,
@@ -88,19 +104,31 @@ namespace vo::create{
         const std::string& appName, 
         const std::string& engineName,
         const std::vector<const char*>& layers,
-        const std::vector<const char*>& extensions
+        const std::vector<const char*>& extensions,
+        vk::Optional<const vk::AllocationCallbacks> allocator
     ){
         vk::ApplicationInfo appInfo{};
         appInfo.pApplicationName = "Hello Triangle";
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        // 1.1 for vkGetPhysicalDeviceMemoryProperties2, which reads the
+        // VK_EXT_memory_budget figures. A 1.0 loader rejects it, there
+        // the KHR extension provides the same query when available.
+        appInfo.apiVersion = utils::instanceVersion(context);
+        std::vector<const char*> enabled=extensions;
+        if(appInfo.apiVersion<VK_API_VERSION_1_1){
+            for(const vk::ExtensionProperties& extension:context.enumerateInstanceExtensionProperties()){
+                if(std::string(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)==extension.extensionName.data()){
+                    enabled.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+                }
+            }
+        }
 
         vk::InstanceCreateInfo createInfo{};
         createInfo.pApplicationInfo = &appInfo;
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-        createInfo.ppEnabledExtensionNames = extensions.data();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(enabled.size());
+        createInfo.ppEnabledExtensionNames = enabled.data();
 
         VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
         if (enableValidationLayers) {
@@ -115,7 +143,20 @@ namespace vo::create{
             createInfo.pNext = nullptr;
         }
 
-        return vk::raii::Instance(context,createInfo);
+        return vk::raii::Instance(context,createInfo,allocator);
+    }
+
+    vk::raii::DebugUtilsMessengerEXT debugMessenger(
+        const vk::raii::Instance& instance,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        VkDebugUtilsMessengerCreateInfoEXT createInfo{};
+        populateDebugMessengerCreateInfo(createInfo);
+        return vk::raii::DebugUtilsMessengerEXT(
+            instance,
+            *reinterpret_cast<const vk::DebugUtilsMessengerCreateInfoEXT*>(&createInfo),
+            allocator
+        );
     }
 
     vk::raii::PhysicalDevice physicalDevice(const vk::raii::Instance &instance){
@@ -138,7 +179,8 @@ namespace vo::create{
         const vk::raii::PhysicalDevice &physicalDevice,
         const QueueFamily& family,
         const std::vector<const char*>& layers,
-        const std::vector<const char*>& extensions
+        const std::vector<const char*>& extensions,
+        vk::Optional<const vk::AllocationCallbacks> allocator
     ){
         const float priority=1.0f;
         vk::DeviceQueueCreateInfo queueInfo(
@@ -157,7 +199,7 @@ namespace vo::create{
             &features
         );
 
-        return physicalDevice.createDevice(deviceInfo);
+        return physicalDevice.createDevice(deviceInfo,allocator);
     }
 
     vk::raii::Queue queue(
@@ -177,11 +219,16 @@ namespace vo::create{
 
     vk::raii::SurfaceKHR surface(
         const vk::raii::Instance& instance,
-        GLFWwindow* handle
+        GLFWwindow* handle,
+        vk::Optional<const vk::AllocationCallbacks> allocator
     ){
         VkSurfaceKHR _surface;
-        glfwCreateWindowSurface(static_cast<VkInstance>(*instance),handle,nullptr,&_surface);
-        return vk::raii::SurfaceKHR(instance,_surface);
+        const vk::AllocationCallbacks* callbacks=allocator;
+        glfwCreateWindowSurface(
+            static_cast<VkInstance>(*instance),handle,
+            reinterpret_cast<const VkAllocationCallbacks*>(callbacks),&_surface
+        );
+        return vk::raii::SurfaceKHR(instance,_surface,allocator);
     }
 
     std::vector<vk::Image> images(
@@ -193,7 +240,8 @@ namespace vo::create{
     std::vector<vk::raii::ImageView> imageViews(
         const vk::raii::Device& device,
         const std::vector<vk::Image>& images,
-        vk::Format imageFormat
+        vk::Format imageFormat,
+        vk::Optional<const vk::AllocationCallbacks> allocator
     ){
         std::vector<vk::raii::ImageView> views;
         views.reserve(images.size());
@@ -219,23 +267,28 @@ namespace vo::create{
                 mapping,
                 resourceRange
             );
-            views.emplace_back(device.createImageView(viewInfo));
+            views.emplace_back(device.createImageView(viewInfo,allocator));
         }
         return views;
     }
     vk::raii::ShaderModule shaderModule(
         const vk::raii::Device& device,
-        const std::vector<char>& code
+        const std::vector<char>& code,
+        vk::Optional<const vk::AllocationCallbacks> allocator
     ){
         vk::ShaderModuleCreateInfo shaderInfo(
             {},
             (size_t)code.size(),
             reinterpret_cast<const uint32_t*>(code.data())
         );
-        return device.createShaderModule(shaderInfo);
+        return device.createShaderModule(shaderInfo,allocator);
     }
 
-    vk::raii::RenderPass renderpass(const vk::raii::Device& device,const ImageInfo& imageInfo){
+    vk::raii::RenderPass renderpass(
+        const vk::raii::Device& device,
+        const ImageInfo& imageInfo,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
         vk::AttachmentDescription attachmentDescription(
             {},
             imageInfo.format,
@@ -266,16 +319,19 @@ namespace vo::create{
             &subpassDescription
         );
 
-        return device.createRenderPass(renderpassInfo);
+        return device.createRenderPass(renderpassInfo,allocator);
     }
 
-    vk::raii::PipelineLayout layout(const vk::raii::Device& device){
+    vk::raii::PipelineLayout layout(
+        const vk::raii::Device& device,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
         vk::PipelineLayoutCreateInfo layoutInfo(
             {},
             0,nullptr
         );
 
-        return device.createPipelineLayout(layoutInfo);
+        return device.createPipelineLayout(layoutInfo,allocator);
     }
     
     vk::raii::Pipeline pipeline(
@@ -284,7 +340,7 @@ namespace vo::create{
         const vk::raii::ShaderModule& fragModule,
         const vk::raii::RenderPass& renderpass,
         const vk::raii::PipelineLayout& layout,
-        const SwapchainInfo& swapchainInfo
+        vk::Optional<const vk::AllocationCallbacks> allocator
     ){
         vk::PipelineShaderStageCreateInfo vertexShaderInfo(
             {},
@@ -302,9 +358,12 @@ namespace vo::create{
         std::vector<vk::PipelineShaderStageCreateInfo> shaderInfos={
             vertexShaderInfo,fragmentShaderInfo
         };
+        // Contours are separated by ps::restartIndex, so one drawIndexed
+        // covers every contour of a glyph run.
         vk::PipelineInputAssemblyStateCreateInfo assemblyInfo(
             {},
-            vk::PrimitiveTopology::eLineStrip
+            vk::PrimitiveTopology::eLineStrip,
+            vk::True
         );
 
         auto bindingDescription=Vertex::getBindingDescription();
@@ -336,21 +395,21 @@ namespace vo::create{
             vk::False
         );
 
-        vk::Viewport viewport(
-            0,0,swapchainInfo.extent.width,
-            swapchainInfo.extent.height,
-            0.0f,1.0f
-        );
-
-        vk::Rect2D scissor(
-            {0,0},
-            swapchainInfo.extent
+        // Viewport and scissor are set while recording, so the pipeline
+        // does not depend on the swapchain extent.
+        vk::PipelineViewportStateCreateInfo viewportInfo(
+            {},
+            1,nullptr,
+            1,nullptr
         );
 
-        vk::PipelineViewportStateCreateInfo viewportInfo(
+        std::array<vk::DynamicState,2> dynamicStates={
+            vk::DynamicState::eViewport,
+            vk::DynamicState::eScissor
+        };
+        vk::PipelineDynamicStateCreateInfo dynamicInfo(
             {},
-            viewport,
-            scissor
+            dynamicStates
         );
 
         vk::PipelineColorBlendAttachmentState colorAttachmentInfo(
@@ -381,16 +440,130 @@ namespace vo::create{
             &viewportInfo,
             &rasterizationInfo,&multisampleInfo,
             nullptr,&colorBlendInfo,
-            nullptr,layout,renderpass,0
+            &dynamicInfo,layout,renderpass,0
         );
 
-        return device.createGraphicsPipeline(nullptr,gpCreateInfo);
+        return device.createGraphicsPipeline(nullptr,gpCreateInfo,allocator);
+    }
+
+    vk::raii::Pipeline curvePipeline(
+        const vk::raii::Device& device,
+        const vk::raii::ShaderModule& vertModule,
+        const vk::raii::ShaderModule& fragModule,
+        const vk::raii::RenderPass& renderpass,
+        const vk::raii::PipelineLayout& layout,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        vk::PipelineShaderStageCreateInfo vertexShaderInfo(
+            {},
+            vk::ShaderStageFlagBits::eVertex,
+            vertModule,
+            "main"
+        );
+        vk::PipelineShaderStageCreateInfo fragmentShaderInfo(
+            {},
+            vk::ShaderStageFlagBits::eFragment,
+            fragModule,
+            "main"
+        );
+
+        std::vector<vk::PipelineShaderStageCreateInfo> shaderInfos={
+            vertexShaderInfo,fragmentShaderInfo
+        };
+        vk::PipelineInputAssemblyStateCreateInfo assemblyInfo(
+            {},
+            vk::PrimitiveTopology::eTriangleList
+        );
+
+        auto bindingDescription=CurveVertex::getBindingDescription();
+        auto attributeDescription=CurveVertex::getAttributeDescription();
+
+        vk::PipelineVertexInputStateCreateInfo vertexInput(
+            {},
+            bindingDescription,
+            attributeDescription
+        );
+
+        // Fan and curve triangles of a contour overlap with both
+        // windings, so nothing may be culled.
+        vk::PipelineRasterizationStateCreateInfo rasterizationInfo(
+            {},
+            vk::False,
+            vk::False,
+            vk::PolygonMode::eFill,
+            vk::CullModeFlagBits::eNone,
+            vk::FrontFace::eClockwise,
+            vk::False,
+            {},
+            {},
+            {},
+            1.0f
+        );
+
+        vk::PipelineMultisampleStateCreateInfo multisampleInfo(
+            {},
+            vk::SampleCountFlagBits::e1,
+            vk::False
+        );
+
+        // Viewport and scissor are set while recording, so the pipeline
+        // does not depend on the swapchain extent.
+        vk::PipelineViewportStateCreateInfo viewportInfo(
+            {},
+            1,nullptr,
+            1,nullptr
+        );
+
+        std::array<vk::DynamicState,2> dynamicStates={
+            vk::DynamicState::eViewport,
+            vk::DynamicState::eScissor
+        };
+        vk::PipelineDynamicStateCreateInfo dynamicInfo(
+            {},
+            dynamicStates
+        );
+
+        // dst=1-dst: every covering triangle inverts the pixel, so the
+        // overlap count decides the even-odd fill without a stencil.
+        vk::PipelineColorBlendAttachmentState colorAttachmentInfo(
+            vk::True,
+            vk::BlendFactor::eOneMinusDstColor,
+            vk::BlendFactor::eZero,
+            vk::BlendOp::eAdd,
+            vk::BlendFactor::eZero,
+            vk::BlendFactor::eOne,
+            vk::BlendOp::eAdd,
+            vk::ColorComponentFlagBits::eR |
+            vk::ColorComponentFlagBits::eG |
+            vk::ColorComponentFlagBits::eB |
+            vk::ColorComponentFlagBits::eA
+        );
+
+        vk::PipelineColorBlendStateCreateInfo colorBlendInfo(
+            {},
+            vk::False,
+            vk::LogicOp::eClear,
+            1,
+            &colorAttachmentInfo
+        );
+
+        vk::GraphicsPipelineCreateInfo gpCreateInfo(
+            {},2,shaderInfos.data(),&vertexInput,
+            &assemblyInfo,{},
+            &viewportInfo,
+            &rasterizationInfo,&multisampleInfo,
+            nullptr,&colorBlendInfo,
+            &dynamicInfo,layout,renderpass,0
+        );
+
+        return device.createGraphicsPipeline(nullptr,gpCreateInfo,allocator);
     }
     std::vector<vk::raii::Framebuffer> framebuffers(
         const vk::raii::Device& device,
         const vk::raii::RenderPass& renderpass,
         const std::vector<vk::raii::ImageView>& views,
-        const ImageInfo& imageInfo
+        const ImageInfo& imageInfo,
+        vk::Optional<const vk::AllocationCallbacks> allocator
     ){
         std::vector<vk::raii::Framebuffer> buffers;
         buffers.reserve(views.size());
@@ -403,19 +576,20 @@ namespace vo::create{
                 imageInfo.height,
                 1
             );
-            buffers.emplace_back(device.createFramebuffer(bufferInfo));
+            buffers.emplace_back(device.createFramebuffer(bufferInfo,allocator));
         }
         return buffers;
     }
     vk::raii::CommandPool commandpool(
         const vk::raii::Device& device,
-        const QueueFamily& family
+        const QueueFamily& family,
+        vk::Optional<const vk::AllocationCallbacks> allocator
     ){
         vk::CommandPoolCreateInfo poolInfo(
             vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
             family.graphicsFamily.value()
         );
-        return device.createCommandPool(poolInfo);
+        return device.createCommandPool(poolInfo,allocator);
     }
 
     vk::raii::CommandBuffer commandbuffer(
@@ -432,7 +606,23 @@ namespace vo::create{
 
     vk::raii::Buffer vertexbuffer(
         const vk::raii::Device& device,
-        std::vector<Vertex> vertices
+        std::vector<Vertex> vertices,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        vk::BufferCreateInfo bufferInfo(
+            {},
+            sizeof(vertices[0])*vertices.size(),
+            vk::BufferUsageFlagBits::eVertexBuffer,
+            vk::SharingMode::eExclusive
+        );
+
+        return device.createBuffer(bufferInfo,allocator);
+    }
+
+    vk::raii::Buffer vertexbuffer(
+        const vk::raii::Device& device,
+        const std::vector<CurveVertex>& vertices,
+        vk::Optional<const vk::AllocationCallbacks> allocator
     ){
         vk::BufferCreateInfo bufferInfo(
             {},
@@ -441,7 +631,243 @@ namespace vo::create{
             vk::SharingMode::eExclusive
         );
 
-        return device.createBuffer(bufferInfo);
+        return device.createBuffer(bufferInfo,allocator);
+    }
+
+    vk::raii::Buffer indexbuffer(
+        const vk::raii::Device& device,
+        const std::vector<uint32_t>& indices,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        vk::BufferCreateInfo bufferInfo(
+            {},
+            sizeof(indices[0])*indices.size(),
+            vk::BufferUsageFlagBits::eIndexBuffer,
+            vk::SharingMode::eExclusive
+        );
+
+        return device.createBuffer(bufferInfo,allocator);
+    }
+
+    // Goes through the residency manager when there is one, so the
+    // memory is charged to its heap and may push out cold residents.
+    static vk::raii::DeviceMemory bufferMemory(
+        const vk::raii::PhysicalDevice& physicalDevice,
+        const vk::raii::Device& device,
+        const vk::MemoryRequirements& requirements,
+        vk::MemoryPropertyFlags required,
+        vk::MemoryPropertyFlags preferred,
+        ResidencyManager* residency,
+        MemoryCharge& charge,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        if(residency) return residency->allocate(device,requirements,required,preferred,charge,allocator);
+        return vo::utils::allocateBuffer(
+            device,requirements,
+            vo::utils::findMemoryType(physicalDevice,requirements.memoryTypeBits,required),
+            allocator
+        );
+    }
+
+    template<typename V>
+    static MeshBuffers createMesh(
+        const vk::raii::PhysicalDevice& physicalDevice,
+        const vk::raii::Device& device,
+        const std::vector<V>& vertices,
+        const std::vector<uint32_t>& indices,
+        vk::Optional<const vk::AllocationCallbacks> allocator,
+        ResidencyManager* residency
+    ){
+        vk::MemoryPropertyFlags hostVisible=
+            vk::MemoryPropertyFlagBits::eHostVisible |
+            vk::MemoryPropertyFlagBits::eHostCoherent;
+        // Host-visible device memory, where there is any, saves the GPU
+        // from reading vertices over the bus.
+        vk::MemoryPropertyFlags preferred=vk::MemoryPropertyFlagBits::eDeviceLocal;
+        MemoryCharge charge;
+
+        vk::raii::Buffer vertexBuffer=vertexbuffer(device,vertices,allocator);
+        vk::MemoryRequirements vertexRequirements=vertexBuffer.getMemoryRequirements();
+        vk::raii::DeviceMemory vertexMemory=bufferMemory(
+            physicalDevice,device,vertexRequirements,hostVisible,preferred,
+            residency,charge,allocator
+        );
+        vo::utils::fillBuffer(vertexBuffer,vertexMemory,vertexRequirements,vertices);
+
+        vk::raii::Buffer indexBuffer=indexbuffer(device,indices,allocator);
+        vk::MemoryRequirements indexRequirements=indexBuffer.getMemoryRequirements();
+        vk::raii::DeviceMemory indexMemory=bufferMemory(
+            physicalDevice,device,indexRequirements,hostVisible,preferred,
+            residency,charge,allocator
+        );
+        vo::utils::fillBuffer(indexBuffer,indexMemory,indexRequirements,indices);
+
+        return MeshBuffers{
+            std::move(vertexBuffer),
+            std::move(vertexMemory),
+            std::move(indexBuffer),
+            std::move(indexMemory),
+            static_cast<uint32_t>(indices.size()),
+            std::move(charge)
+        };
+    }
+
+    MeshBuffers meshBuffers(
+        const vk::raii::PhysicalDevice& physicalDevice,
+        const vk::raii::Device& device,
+        const std::vector<Vertex>& vertices,
+        const std::vector<uint32_t>& indices,
+        vk::Optional<const vk::AllocationCallbacks> allocator,
+        ResidencyManager* residency
+    ){
+        return createMesh(physicalDevice,device,vertices,indices,allocator,residency);
+    }
+
+    MeshBuffers meshBuffers(
+        const vk::raii::PhysicalDevice& physicalDevice,
+        const vk::raii::Device& device,
+        const std::vector<CurveVertex>& vertices,
+        const std::vector<uint32_t>& indices,
+        vk::Optional<const vk::AllocationCallbacks> allocator,
+        ResidencyManager* residency
+    ){
+        return createMesh(physicalDevice,device,vertices,indices,allocator,residency);
+    }
+
+    vk::raii::DescriptorSetLayout cullSetLayout(
+        const vk::raii::Device& device,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        std::array<vk::DescriptorSetLayoutBinding,2> bindings{
+            vk::DescriptorSetLayoutBinding(0,vk::DescriptorType::eStorageBuffer,1,vk::ShaderStageFlagBits::eCompute),
+            vk::DescriptorSetLayoutBinding(1,vk::DescriptorType::eStorageBuffer,1,vk::ShaderStageFlagBits::eCompute)
+        };
+        vk::DescriptorSetLayoutCreateInfo layoutInfo({},bindings);
+        return device.createDescriptorSetLayout(layoutInfo,allocator);
+    }
+
+    vk::raii::PipelineLayout cullLayout(
+        const vk::raii::Device& device,
+        const vk::raii::DescriptorSetLayout& setLayout,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        vk::PushConstantRange range(
+            vk::ShaderStageFlagBits::eCompute,
+            0,sizeof(CullConstants)
+        );
+        vk::DescriptorSetLayout setLayouts[]={*setLayout};
+        vk::PipelineLayoutCreateInfo layoutInfo(
+            {},
+            setLayouts,
+            range
+        );
+        return device.createPipelineLayout(layoutInfo,allocator);
+    }
+
+    vk::raii::Pipeline cullPipeline(
+        const vk::raii::Device& device,
+        const vk::raii::ShaderModule& compModule,
+        const vk::raii::PipelineLayout& layout,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        vk::PipelineShaderStageCreateInfo computeShaderInfo(
+            {},
+            vk::ShaderStageFlagBits::eCompute,
+            compModule,
+            "main"
+        );
+        vk::ComputePipelineCreateInfo cpCreateInfo(
+            {},
+            computeShaderInfo,
+            layout
+        );
+        return device.createComputePipeline(nullptr,cpCreateInfo,allocator);
+    }
+
+    vk::raii::DescriptorPool descriptorPool(
+        const vk::raii::Device& device,
+        uint32_t maxSets,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        vk::DescriptorPoolSize poolSize(
+            vk::DescriptorType::eStorageBuffer,
+            maxSets*2
+        );
+        vk::DescriptorPoolCreateInfo poolInfo(
+            vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+            maxSets,
+            poolSize
+        );
+        return device.createDescriptorPool(poolInfo,allocator);
+    }
+
+    CullBuffers cullBuffers(
+        const vk::raii::PhysicalDevice& physicalDevice,
+        const vk::raii::Device& device,
+        const vk::raii::DescriptorPool& pool,
+        const vk::raii::DescriptorSetLayout& setLayout,
+        const std::vector<GpuRun>& runs,
+        vk::Optional<const vk::AllocationCallbacks> allocator,
+        ResidencyManager* residency
+    ){
+        MemoryCharge charge;
+        vk::BufferCreateInfo runInfo(
+            {},
+            sizeof(GpuRun)*runs.size(),
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::SharingMode::eExclusive
+        );
+        vk::raii::Buffer runBuffer=device.createBuffer(runInfo,allocator);
+        vk::MemoryRequirements runRequirements=runBuffer.getMemoryRequirements();
+        vk::raii::DeviceMemory runMemory=bufferMemory(
+            physicalDevice,device,runRequirements,
+            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+            {},residency,charge,allocator
+        );
+        void* data=runMemory.mapMemory(0,runInfo.size);
+        memcpy(data,runs.data(),runInfo.size);
+        runMemory.unmapMemory();
+        runBuffer.bindMemory(runMemory,0);
+
+        // Only ever written by the GPU: cleared, filled by the cull pass
+        // and read as indirect commands.
+        vk::BufferCreateInfo drawInfo(
+            {},
+            CullBuffers::drawOffset+sizeof(vk::DrawIndexedIndirectCommand)*runs.size(),
+            vk::BufferUsageFlagBits::eStorageBuffer |
+            vk::BufferUsageFlagBits::eIndirectBuffer |
+            vk::BufferUsageFlagBits::eTransferDst,
+            vk::SharingMode::eExclusive
+        );
+        vk::raii::Buffer drawBuffer=device.createBuffer(drawInfo,allocator);
+        vk::MemoryRequirements drawRequirements=drawBuffer.getMemoryRequirements();
+        vk::raii::DeviceMemory drawMemory=bufferMemory(
+            physicalDevice,device,drawRequirements,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            {},residency,charge,allocator
+        );
+        drawBuffer.bindMemory(drawMemory,0);
+
+        vk::DescriptorSetLayout setLayouts[]={*setLayout};
+        vk::DescriptorSetAllocateInfo setInfo(pool,setLayouts);
+        vk::raii::DescriptorSet descriptorSet=std::move(device.allocateDescriptorSets(setInfo).front());
+        vk::DescriptorBufferInfo runDescriptor(*runBuffer,0,VK_WHOLE_SIZE);
+        vk::DescriptorBufferInfo drawDescriptor(*drawBuffer,0,VK_WHOLE_SIZE);
+        std::array<vk::WriteDescriptorSet,2> writes{
+            vk::WriteDescriptorSet(*descriptorSet,0,0,1,vk::DescriptorType::eStorageBuffer,nullptr,&runDescriptor),
+            vk::WriteDescriptorSet(*descriptorSet,1,0,1,vk::DescriptorType::eStorageBuffer,nullptr,&drawDescriptor)
+        };
+        device.updateDescriptorSets(writes,nullptr);
+
+        return CullBuffers{
+            std::move(runBuffer),
+            std::move(runMemory),
+            std::move(drawBuffer),
+            std::move(drawMemory),
+            std::move(descriptorSet),
+            static_cast<uint32_t>(runs.size()),
+            std::move(charge)
+        };
     }
 }
 
@@ -465,16 +891,27 @@ namespace vo::utils{
         return family;
     }
 
-    SwapchainInfo querySwapChainInfo(
+    bool hasDeviceExtension(
+        const vk::raii::PhysicalDevice& physicalDevice,
+        const std::string& name
+    ){
+        for(const vk::ExtensionProperties& extension:physicalDevice.enumerateDeviceExtensionProperties()){
+            if(name==extension.extensionName.data()) return true;
+        }
+        return false;
+    }
+
+    uint32_t instanceVersion(const vk::raii::Context& context){
+        // 1.0 loaders do not export vkEnumerateInstanceVersion.
+        if(!context.getDispatcher()->vkEnumerateInstanceVersion) return VK_API_VERSION_1_0;
+        return std::min<uint32_t>(context.enumerateInstanceVersion(),VK_API_VERSION_1_1);
+    }
+
+    vk::SurfaceFormatKHR pickSurfaceFormat(
         const vk::raii::PhysicalDevice& device,
-        const vk::raii::Device& logicalDevice,
-        const vk::raii::SurfaceKHR& surface,
-        GLFWwindow* handle
+        const vk::raii::SurfaceKHR& surface
     ){
-        auto capabilities=device.getSurfaceCapabilitiesKHR(surface);
         std::vector<vk::SurfaceFormatKHR> formats=device.getSurfaceFormatsKHR(surface);
-        std::vector<vk::PresentModeKHR> presentModes=device.getSurfacePresentModesKHR(surface);
-        
         auto pickFormat=[](const vk::SurfaceFormatKHR& format){
             return format.format==vk::Format::eB8G8R8A8Srgb &&
                    format.colorSpace==vk::ColorSpaceKHR::eSrgbNonlinear;
@@ -482,16 +919,33 @@ namespace vo::utils{
         vk::SurfaceFormatKHR surfaceFormat;
         for(auto& sFormat:formats | std::views::filter(pickFormat))
             surfaceFormat=sFormat;
+        return surfaceFormat;
+    }
+
+    vk::PresentModeKHR pickPresentMode(
+        const vk::raii::PhysicalDevice& device,
+        const vk::raii::SurfaceKHR& surface,
+        const std::vector<vk::PresentModeKHR>& preference
+    ){
+        std::vector<vk::PresentModeKHR> presentModes=device.getSurfacePresentModesKHR(surface);
+        for(vk::PresentModeKHR mode:preference){
+            if(std::ranges::find(presentModes,mode)!=presentModes.end()) return mode;
+        }
+        return vk::PresentModeKHR::eFifo;
+    }
+
+    SwapchainInfo querySwapChainInfo(
+        const vk::raii::PhysicalDevice& device,
+        const vk::raii::Device& logicalDevice,
+        const vk::raii::SurfaceKHR& surface,
+        GLFWwindow* handle,
+        vk::PresentModeKHR presentMode,
+        const vk::raii::SwapchainKHR* oldSwapchain,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        auto capabilities=device.getSurfaceCapabilitiesKHR(surface);
+        vk::SurfaceFormatKHR surfaceFormat=pickSurfaceFormat(device,surface);
 
-        auto pickPresentMode=[](const vk::PresentModeKHR& pMode){
-            return pMode==vk::PresentModeKHR::eMailbox;
-        };
-        vk::PresentModeKHR presentMode;
-        for(auto& pMode:presentModes | std::views::filter(pickPresentMode))
-            presentMode=pMode;
-        
-        if(presentMode!=vk::PresentModeKHR::eMailbox) presentMode=vk::PresentModeKHR::eFifoRelaxed;
-        
         uint32_t imageCount=capabilities.minImageCount+1;
         if(imageCount>0 && imageCount>capabilities.maxImageCount){
             imageCount=capabilities.maxImageCount;
@@ -535,10 +989,10 @@ namespace vo::utils{
             vk::CompositeAlphaFlagBitsKHR::eOpaque,
             presentMode,
             vk::True,
-            nullptr
+            oldSwapchain?**oldSwapchain:vk::SwapchainKHR{}
         );
         return SwapchainInfo{
-            logicalDevice.createSwapchainKHR(swapchainInfo),
+            logicalDevice.createSwapchainKHR(swapchainInfo,allocator),
             capabilities,
             surfaceFormat,
             presentMode,
@@ -546,28 +1000,122 @@ namespace vo::utils{
         };
     }
 
+    SwapchainResources recreateSwapchain(
+        const vk::raii::PhysicalDevice& device,
+        const vk::raii::Device& logicalDevice,
+        const vk::raii::SurfaceKHR& surface,
+        GLFWwindow* handle,
+        const vk::raii::RenderPass& renderpass,
+        const SwapchainResources& old,
+        vk::Optional<const vk::AllocationCallbacks> allocator
+    ){
+        SwapchainInfo info=querySwapChainInfo(
+            device,logicalDevice,surface,handle,old.info.presentMode,
+            &old.info.swapchain,allocator
+        );
+        ImageInfo imageInfo={
+            info.surfaceFormat.format,
+            info.extent.width,
+            info.extent.height
+        };
+        std::vector<vk::Image> images=vo::create::images(info.swapchain);
+        std::vector<vk::raii::ImageView> views=vo::create::imageViews(
+            logicalDevice,images,info.surfaceFormat.format,allocator
+        );
+        std::vector<vk::raii::Framebuffer> framebuffers=vo::create::framebuffers(
+            logicalDevice,renderpass,views,imageInfo,allocator
+        );
+        return SwapchainResources{
+            std::move(info),
+            std::move(images),
+            std::move(views),
+            std::move(framebuffers)
+        };
+    }
+
+    void waitForFrame(
+        const vk::raii::Device& device,
+        FrameSync& sync
+    ){
+        device.waitForFences(*sync.inFlight,vk::True,UINT64_MAX);
+        sync.completed=sync.submitted;
+    }
+
     std::pair<vk::Result,vk::Result> drawFrame(
             const vk::raii::Device& device,
             const SwapchainInfo& swapchain,
             const vk::raii::RenderPass& renderpass,
             const vk::raii::Pipeline& pipeline,
             const vk::raii::CommandBuffer& commandBuffer,
-            const vk::raii::Semaphore& waitSemaphore,
-            const vk::raii::Semaphore& signalSemaphore,
-            const vk::raii::Fence& fence,
+            FrameSync& sync,
             const std::vector<vk::raii::Framebuffer>& framebuffers,
             const vk::raii::Queue& graphicsQueue,
             const vk::raii::Buffer& vertexbuffer,
-            const std::vector<Vertex>& vertices
+            const vk::raii::Buffer& indexbuffer,
+            uint32_t indexCount,
+            const CullPass* cull
     ){
-        device.waitForFences(*fence,vk::True,UINT64_MAX);
-        device.resetFences(*fence);
-        auto [imgResult,imageIndex]=swapchain.swapchain.acquireNextImage(FenceTimeout,waitSemaphore);
+        // Returns at once when the caller already waited.
+        waitForFrame(device,sync);
+
+        vk::Result imgResult;
+        uint32_t imageIndex;
+        try{
+            std::tie(imgResult,imageIndex)=swapchain.swapchain.acquireNextImage(FenceTimeout,*sync.imageAcquired);
+        }catch(const vk::OutOfDateKHRError&){
+            return {vk::Result::eErrorOutOfDateKHR,vk::Result::eErrorOutOfDateKHR};
+        }
+        if(imgResult==vk::Result::eTimeout || imgResult==vk::Result::eNotReady){
+            return {imgResult,imgResult};
+        }
+        // Only reset once an image is acquired, an early return must
+        // leave the fence signalled for the next call.
+        device.resetFences(*sync.inFlight);
         commandBuffer.reset();
         vk::CommandBufferBeginInfo beginInfo(
             {},nullptr
         );
         commandBuffer.begin(beginInfo);
+
+        // The cull runs on the graphics queue ahead of the render pass,
+        // it is a single small dispatch that does not justify a hop to
+        // a separate compute queue and back every frame.
+        bool indirect=cull && cull->buffers.runCount>0 && indexCount>0;
+        if(indirect){
+            const CullBuffers& buffers=cull->buffers;
+            // Zeroed commands draw nothing, so without a draw count the
+            // slots past the survivors are harmless.
+            commandBuffer.fillBuffer(*buffers.drawbuffer,0,VK_WHOLE_SIZE,0);
+            vk::MemoryBarrier clearBarrier(
+                vk::AccessFlagBits::eTransferWrite,
+                vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite
+            );
+            commandBuffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eTransfer,
+                vk::PipelineStageFlagBits::eComputeShader,
+                {},clearBarrier,nullptr,nullptr
+            );
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,cull->pipeline);
+            commandBuffer.bindDescriptorSets(
+                vk::PipelineBindPoint::eCompute,*cull->layout,
+                0,*buffers.descriptorSet,nullptr
+            );
+            CullConstants constants{cull->viewport,buffers.runCount};
+            commandBuffer.pushConstants<CullConstants>(
+                *cull->layout,vk::ShaderStageFlagBits::eCompute,0,constants
+            );
+            commandBuffer.dispatch((buffers.runCount+cullGroupSize-1)/cullGroupSize,1,1);
+            vk::MemoryBarrier cullBarrier(
+                vk::AccessFlagBits::eShaderWrite,
+                vk::AccessFlagBits::eIndirectCommandRead
+            );
+            commandBuffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eComputeShader,
+                vk::PipelineStageFlagBits::eDrawIndirect,
+                {},cullBarrier,nullptr,nullptr
+            );
+        }
+
         vk::Rect2D area(
             {0,0},
             swapchain.extent
@@ -601,12 +1149,39 @@ namespace vo::utils{
         );
         commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,pipeline);
         vk::DeviceSize offset[]={0};
-        commandBuffer.bindVertexBuffers(0,*vertexbuffer,offset);
-        commandBuffer.draw(vertices.size(),1,0,0);
+        if(indexCount>0){
+            commandBuffer.bindVertexBuffers(0,*vertexbuffer,offset);
+            commandBuffer.bindIndexBuffer(*indexbuffer,0,vk::IndexType::eUint32);
+            if(indirect){
+                const CullBuffers& buffers=cull->buffers;
+                uint32_t stride=sizeof(vk::DrawIndexedIndirectCommand);
+                if(cull->drawCount){
+                    commandBuffer.drawIndexedIndirectCountKHR(
+                        *buffers.drawbuffer,CullBuffers::drawOffset,
+                        *buffers.drawbuffer,0,
+                        buffers.runCount,stride
+                    );
+                }else if(cull->multiDraw){
+                    commandBuffer.drawIndexedIndirect(
+                        *buffers.drawbuffer,CullBuffers::drawOffset,
+                        buffers.runCount,stride
+                    );
+                }else{
+                    for(uint32_t i=0;i<buffers.runCount;i++){
+                        commandBuffer.drawIndexedIndirect(
+                            *buffers.drawbuffer,CullBuffers::drawOffset+i*stride,
+                            1,stride
+                        );
+                    }
+                }
+            }else{
+                commandBuffer.drawIndexed(indexCount,1,0,0,0);
+            }
+        }
         commandBuffer.endRenderPass();
         commandBuffer.end();
         vk::PresentInfoKHR presentInfo(
-            *signalSemaphore,
+            *sync.renderFinished,
             *swapchain.swapchain,
             imageIndex
         );
@@ -614,16 +1189,22 @@ namespace vo::utils{
             vk::PipelineStageFlagBits::eColorAttachmentOutput
         );
         vk::SubmitInfo submitInfo(
-            *waitSemaphore,
+            *sync.imageAcquired,
             flags,
             *commandBuffer,
-            *signalSemaphore
+            *sync.renderFinished
         );
         graphicsQueue.submit(
             submitInfo,
-            *fence
+            *sync.inFlight
         );
-        vk::Result presentResult=graphicsQueue.presentKHR(presentInfo);
+        sync.submitted++;
+        vk::Result presentResult;
+        try{
+            presentResult=graphicsQueue.presentKHR(presentInfo);
+        }catch(const vk::OutOfDateKHRError&){
+            presentResult=vk::Result::eErrorOutOfDateKHR;
+        }
 
         return {imgResult,presentResult};
     }
@@ -645,13 +1226,14 @@ namespace vo::utils{
     vk::raii::DeviceMemory allocateBuffer(
         const vk::raii::Device& device,
         const vk::MemoryRequirements& memRequirements,
-        uint32_t memTypeIndex
+        uint32_t memTypeIndex,
+        vk::Optional<const vk::AllocationCallbacks> allocator
     ){
         vk::MemoryAllocateInfo allocInfo(
             memRequirements.size,
             memTypeIndex
         );
-        return device.allocateMemory(allocInfo);
+        return device.allocateMemory(allocInfo,allocator);
     }
 
     void fillBuffer(
@@ -666,5 +1248,30 @@ namespace vo::utils{
         deviceMemory.unmapMemory();
         vertexbuffer.bindMemory(deviceMemory,0);     
     }
-}
 
+    void fillBuffer(
+        const vk::raii::Buffer &vertexbuffer,
+        const vk::raii::DeviceMemory& deviceMemory,
+        const vk::MemoryRequirements &memRequirements,
+        const std::vector<CurveVertex>& vertices
+    ){
+        uint32_t size=sizeof(vertices[0])*vertices.size();
+        void* data=deviceMemory.mapMemory(0, size);
+        memcpy(data,vertices.data(),size);
+        deviceMemory.unmapMemory();
+        vertexbuffer.bindMemory(deviceMemory,0);
+    }
+
+    void fillBuffer(
+        const vk::raii::Buffer &indexbuffer,
+        const vk::raii::DeviceMemory& deviceMemory,
+        const vk::MemoryRequirements &memRequirements,
+        const std::vector<uint32_t>& indices
+    ){
+        uint32_t size=sizeof(indices[0])*indices.size();
+        void* data=deviceMemory.mapMemory(0, size);
+        memcpy(data,indices.data(),size);
+        deviceMemory.unmapMemory();
+        indexbuffer.bindMemory(deviceMemory,0);
+    }
+}
\ No newline at end of file
@@ -1,3 +1,4 @@
+#pragma once
 #include <vulkan/vulkan_raii.hpp>
 #include <vector>
 #include <iostream>
@@ -7,6 +8,9 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <cstddef>
+#include <deque>
+#include <memory>
+#include "residency.hpp"
 
 extern bool framebufferResized;
 
@@ -26,6 +30,49 @@ struct SwapchainInfo{
     vk::Extent2D extent;
 };
 
+// Everything that has to be rebuilt when the surface extent changes.
+// Pipelines are not in here, they use dynamic viewport state.
+struct SwapchainResources{
+    SwapchainInfo info;
+    std::vector<vk::Image> images;
+    std::vector<vk::raii::ImageView> views;
+    std::vector<vk::raii::Framebuffer> framebuffers;
+};
+
+// Per-frame synchronisation. completed trails submitted and tells which
+// frames the GPU is known to be done with.
+struct FrameSync{
+    vk::raii::Semaphore imageAcquired;
+    vk::raii::Semaphore renderFinished;
+    vk::raii::Fence inFlight;
+    uint64_t submitted=0;
+    uint64_t completed=0;
+};
+
+// Holds resources replaced while frames that may use them are still in
+// flight, and destroys them once those frames have completed instead
+// of stalling on device.waitIdle().
+class RetireQueue{
+public:
+    template<typename T>
+    void retire(uint64_t lastFrame,T&& resource){
+        entries.push_back({lastFrame,std::make_shared<std::decay_t<T>>(std::forward<T>(resource))});
+    }
+    void collect(uint64_t completedFrame){
+        while(!entries.empty() && entries.front().lastFrame<=completedFrame){
+            entries.pop_front();
+        }
+    }
+    size_t size() const{ return entries.size(); }
+
+private:
+    struct Entry{
+        uint64_t lastFrame;
+        std::shared_ptr<void> resource;
+    };
+    std::deque<Entry> entries;
+};
+
 struct ImageInfo{
     vk::Format format;
     uint32_t width;
@@ -39,6 +86,56 @@ struct Vertex{
     static std::array<vk::VertexInputAttributeDescription,2> getAttributeDescription();
 };
 
+struct CurveVertex{
+    glm::vec2 pos;
+    glm::vec2 uv;
+    static vk::VertexInputBindingDescription getBindingDescription();
+    static std::array<vk::VertexInputAttributeDescription,2> getAttributeDescription();
+};
+
+struct MeshBuffers{
+    vk::raii::Buffer vertexbuffer;
+    vk::raii::DeviceMemory vertexMemory;
+    vk::raii::Buffer indexbuffer;
+    vk::raii::DeviceMemory indexMemory;
+    uint32_t indexCount;
+    MemoryCharge charge;
+};
+
+// One text run as the cull shader reads it: bounds is min.xy, max.xy
+// in NDC, the layout matches Run in cull.comp.
+struct GpuRun{
+    glm::vec4 bounds;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t padding[2];
+};
+
+// Per-mesh storage of the cull pass. drawbuffer starts with the number
+// of surviving runs, the compacted VkDrawIndexedIndirectCommands follow
+// at drawOffset.
+struct CullBuffers{
+    static constexpr vk::DeviceSize drawOffset=16;
+    vk::raii::Buffer runbuffer;
+    vk::raii::DeviceMemory runMemory;
+    vk::raii::Buffer drawbuffer;
+    vk::raii::DeviceMemory drawMemory;
+    vk::raii::DescriptorSet descriptorSet;
+    uint32_t runCount;
+    MemoryCharge charge;
+};
+
+// Turns drawFrame into a compute cull followed by one indirect draw.
+// drawCount is set when VK_KHR_draw_indirect_count is enabled,
+// multiDraw when the multiDrawIndirect feature is.
+struct CullPass{
+    const vk::raii::Pipeline& pipeline;
+    const vk::raii::PipelineLayout& layout;
+    const CullBuffers& buffers;
+    glm::vec4 viewport;
+    bool drawCount;
+    bool multiDraw;
+};
 
 namespace vo{
     namespace create{
@@ -52,10 +149,12 @@ namespace vo{
             const std::string& appName,
             const std::string& engineName,
             const std::vector<const char*>& layers={},
-            const std::vector<const char*>& extensions={}
+            const std::vector<const char*>& extensions={},
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         vk::raii::DebugUtilsMessengerEXT debugMessenger(
-            const vk::raii::Instance& instance
+            const vk::raii::Instance& instance,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         vk::raii::PhysicalDevice physicalDevice(
             const vk::raii::Instance& instance
@@ -64,7 +163,8 @@ namespace vo{
             const vk::raii::PhysicalDevice& physicalDevice,
             const QueueFamily& family,
             const std::vector<const char*>& layers={},
-            const std::vector<const char*>& extensions={}
+            const std::vector<const char*>& extensions={},
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         vk::raii::Queue queue(
             const vk::raii::Device& device,
@@ -72,42 +172,59 @@ namespace vo{
         );
         vk::raii::SurfaceKHR surface(
             const vk::raii::Instance& instance,
-            GLFWwindow* handle
+            GLFWwindow* handle,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         std::vector<vk::Image> images(const vk::raii::SwapchainKHR& swapchain);
         std::vector<vk::raii::ImageView> imageViews(
             const vk::raii::Device& device,
             const std::vector<vk::Image>& images,
-            vk::Format imageFormat
+            vk::Format imageFormat,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         vk::raii::ShaderModule shaderModule(
             const vk::raii::Device& device,
-            const std::vector<char>& code
+            const std::vector<char>& code,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         vk::raii::RenderPass renderpass(
             const vk::raii::Device& device,
-            const ImageInfo& imageInfo
+            const ImageInfo& imageInfo,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         vk::raii::PipelineLayout layout(
-            const vk::raii::Device& device
+            const vk::raii::Device& device,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
+        // Line strips with primitive restart, for outlines built with
+        // IndexMode::eLineStrip.
         vk::raii::Pipeline pipeline(
             const vk::raii::Device& device,
             const vk::raii::ShaderModule& vertModule,
             const vk::raii::ShaderModule& fragModule,
             const vk::raii::RenderPass& renderpass,
             const vk::raii::PipelineLayout& layout,
-            const SwapchainInfo& swapchainInfo
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
+        );
+        vk::raii::Pipeline curvePipeline(
+            const vk::raii::Device& device,
+            const vk::raii::ShaderModule& vertModule,
+            const vk::raii::ShaderModule& fragModule,
+            const vk::raii::RenderPass& renderpass,
+            const vk::raii::PipelineLayout& layout,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         std::vector<vk::raii::Framebuffer> framebuffers(
             const vk::raii::Device& device,
             const vk::raii::RenderPass& renderpass,
             const std::vector<vk::raii::ImageView>& views,
-            const ImageInfo& imageInfo
+            const ImageInfo& imageInfo,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         vk::raii::CommandPool commandpool(
             const vk::raii::Device& device,
-            const QueueFamily& family
+            const QueueFamily& family,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         vk::raii::CommandBuffer commandbuffer(
             const vk::raii::Device& device,
@@ -115,33 +232,141 @@ namespace vo{
         );
         vk::raii::Buffer vertexbuffer(
             const vk::raii::Device& device,
-            std::vector<Vertex> vertices
+            std::vector<Vertex> vertices,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
+        );
+        vk::raii::Buffer vertexbuffer(
+            const vk::raii::Device& device,
+            const std::vector<CurveVertex>& vertices,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
-        
+        vk::raii::Buffer indexbuffer(
+            const vk::raii::Device& device,
+            const std::vector<uint32_t>& indices,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
+        );
+        // Host-visible vertex and index buffers filled in one go, both
+        // vectors must be non-empty. With a residency manager the memory
+        // is charged to mesh.charge and may evict cold residents.
+        MeshBuffers meshBuffers(
+            const vk::raii::PhysicalDevice& physicalDevice,
+            const vk::raii::Device& device,
+            const std::vector<Vertex>& vertices,
+            const std::vector<uint32_t>& indices,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr,
+            ResidencyManager* residency=nullptr
+        );
+        MeshBuffers meshBuffers(
+            const vk::raii::PhysicalDevice& physicalDevice,
+            const vk::raii::Device& device,
+            const std::vector<CurveVertex>& vertices,
+            const std::vector<uint32_t>& indices,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr,
+            ResidencyManager* residency=nullptr
+        );
+        // Two storage buffers for the compute stage: runs, then draws.
+        vk::raii::DescriptorSetLayout cullSetLayout(
+            const vk::raii::Device& device,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
+        );
+        vk::raii::PipelineLayout cullLayout(
+            const vk::raii::Device& device,
+            const vk::raii::DescriptorSetLayout& setLayout,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
+        );
+        vk::raii::Pipeline cullPipeline(
+            const vk::raii::Device& device,
+            const vk::raii::ShaderModule& compModule,
+            const vk::raii::PipelineLayout& layout,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
+        );
+        // Sets can be freed individually, each holds two storage buffers.
+        vk::raii::DescriptorPool descriptorPool(
+            const vk::raii::Device& device,
+            uint32_t maxSets,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
+        );
+        // Uploads the runs and allocates the draw buffer and descriptor
+        // set for them, runs must be non-empty.
+        CullBuffers cullBuffers(
+            const vk::raii::PhysicalDevice& physicalDevice,
+            const vk::raii::Device& device,
+            const vk::raii::DescriptorPool& pool,
+            const vk::raii::DescriptorSetLayout& setLayout,
+            const std::vector<GpuRun>& runs,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr,
+            ResidencyManager* residency=nullptr
+        );
+
     };
     namespace utils{
         QueueFamily findQueueFamily(
             const vk::raii::PhysicalDevice& physicalDevice
         );
+        bool hasDeviceExtension(
+            const vk::raii::PhysicalDevice& physicalDevice,
+            const std::string& name
+        );
+        // The version vo::create::instance asks for, 1.1 unless the
+        // loader only knows 1.0.
+        uint32_t instanceVersion(const vk::raii::Context& context);
+        // The format querySwapChainInfo will pick, available before the
+        // swapchain exists so the render pass can be built in parallel.
+        vk::SurfaceFormatKHR pickSurfaceFormat(
+            const vk::raii::PhysicalDevice& device,
+            const vk::raii::SurfaceKHR& surface
+        );
+        // First mode of preference the surface supports, FIFO otherwise.
+        vk::PresentModeKHR pickPresentMode(
+            const vk::raii::PhysicalDevice& device,
+            const vk::raii::SurfaceKHR& surface,
+            const std::vector<vk::PresentModeKHR>& preference
+        );
         SwapchainInfo querySwapChainInfo(
             const vk::raii::PhysicalDevice& device,
             const vk::raii::Device& logicalDevice,
             const vk::raii::SurfaceKHR& surface,
-            GLFWwindow* handle
+            GLFWwindow* handle,
+            vk::PresentModeKHR presentMode,
+            const vk::raii::SwapchainKHR* oldSwapchain=nullptr,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
+        );
+        // Builds a swapchain for the current surface extent from the old
+        // one, together with its image views and framebuffers. The old
+        // resources stay valid and should be retired by the caller, the
+        // present mode is kept.
+        SwapchainResources recreateSwapchain(
+            const vk::raii::PhysicalDevice& device,
+            const vk::raii::Device& logicalDevice,
+            const vk::raii::SurfaceKHR& surface,
+            GLFWwindow* handle,
+            const vk::raii::RenderPass& renderpass,
+            const SwapchainResources& old,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
+        // Blocks until the previous frame's fence is signalled, lets the
+        // caller latch input only once the GPU can take a new frame.
+        void waitForFrame(
+            const vk::raii::Device& device,
+            FrameSync& sync
+        );
+        // Returns the acquire and present results, eErrorOutOfDateKHR
+        // is reported rather than thrown so the caller can recreate.
+        // With a cull pass the runs are culled on the GPU and drawn
+        // indirectly, otherwise all indexCount indices are drawn.
         std::pair<vk::Result,vk::Result> drawFrame(
             const vk::raii::Device& device,
             const SwapchainInfo& swapchain,
             const vk::raii::RenderPass& renderpass,
             const vk::raii::Pipeline& pipeline,
             const vk::raii::CommandBuffer& commandBuffer,
-            const vk::raii::Semaphore& waitSemaphore,
-            const vk::raii::Semaphore& signalSemaphore,
-            const vk::raii::Fence& fence,
+            FrameSync& sync,
             const std::vector<vk::raii::Framebuffer>& framebuffers,
             const vk::raii::Queue& graphicsQueue,
             const vk::raii::Buffer& vertexbuffer,
-            const std::vector<Vertex>& vertices
+            const vk::raii::Buffer& indexbuffer,
+            uint32_t indexCount,
+            const CullPass* cull=nullptr
         );
         uint32_t findMemoryType(
             const vk::raii::PhysicalDevice& device,
@@ -151,7 +376,8 @@ namespace vo{
         vk::raii::DeviceMemory allocateBuffer(
             const vk::raii::Device& device,
             const vk::MemoryRequirements& memRequirements,
-            uint32_t memTypeIndex
+            uint32_t memTypeIndex,
+            vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
         );
         void fillBuffer(
             const vk::raii::Buffer &vertexbuffer,
@@ -159,5 +385,17 @@ namespace vo{
             const vk::MemoryRequirements &memRequirements,
             std::vector<Vertex> vertices
         );
+        void fillBuffer(
+            const vk::raii::Buffer &vertexbuffer,
+            const vk::raii::DeviceMemory& deviceMemory,
+            const vk::MemoryRequirements &memRequirements,
+            const std::vector<CurveVertex>& vertices
+        );
+        void fillBuffer(
+            const vk::raii::Buffer &indexbuffer,
+            const vk::raii::DeviceMemory& deviceMemory,
+            const vk::MemoryRequirements &memRequirements,
+            const std::vector<uint32_t>& indices
+        );
     };
 };
\ No newline at end of file
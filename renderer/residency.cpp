@@ -0,0 +1,269 @@
+#include "residency.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+
+namespace{
+    double toMb(uint64_t bytes){
+        return bytes/(1024.0*1024.0);
+    }
+}
+
+MemoryCharge::~MemoryCharge(){
+    release();
+}
+
+MemoryCharge::MemoryCharge(MemoryCharge&& other) noexcept
+:owner(std::exchange(other.owner,nullptr)),heapBytes(std::exchange(other.heapBytes,{})){}
+
+MemoryCharge& MemoryCharge::operator=(MemoryCharge&& other) noexcept{
+    if(this!=&other){
+        release();
+        owner=std::exchange(other.owner,nullptr);
+        heapBytes=std::exchange(other.heapBytes,{});
+    }
+    return *this;
+}
+
+uint64_t MemoryCharge::bytes() const{
+    uint64_t total=0;
+    for(uint64_t heap:heapBytes) total+=heap;
+    return total;
+}
+
+void MemoryCharge::release(){
+    if(owner) owner->release(heapBytes);
+    owner=nullptr;
+    heapBytes={};
+}
+
+ResidencyManager::ResidencyManager(
+    const vk::raii::PhysicalDevice& physicalDevice,
+    uint32_t apiVersion,
+    bool memoryBudget,
+    uint64_t byteLimit
+):physicalDevice(physicalDevice),memoryBudget(memoryBudget),byteLimit(byteLimit){
+    if(apiVersion<VK_API_VERSION_1_1){
+        khrProperties2=physicalDevice.getDispatcher()->vkGetPhysicalDeviceMemoryProperties2KHR!=nullptr;
+        this->memoryBudget=memoryBudget && khrProperties2;
+    }
+    memoryProperties=physicalDevice.getMemoryProperties();
+    refresh();
+}
+
+void ResidencyManager::setReclaim(std::function<bool()> reclaim){
+    this->reclaim=std::move(reclaim);
+}
+
+void ResidencyManager::refresh(){
+    uint64_t limit=byteLimit?byteLimit:std::numeric_limits<uint64_t>::max();
+    if(memoryBudget){
+        using Chain=vk::StructureChain<
+            vk::PhysicalDeviceMemoryProperties2,
+            vk::PhysicalDeviceMemoryBudgetPropertiesEXT
+        >;
+        Chain chain=khrProperties2?
+            physicalDevice.getMemoryProperties2KHR<
+                vk::PhysicalDeviceMemoryProperties2,
+                vk::PhysicalDeviceMemoryBudgetPropertiesEXT
+            >():
+            physicalDevice.getMemoryProperties2<
+                vk::PhysicalDeviceMemoryProperties2,
+                vk::PhysicalDeviceMemoryBudgetPropertiesEXT
+            >();
+        const auto& budgets=chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        for(uint32_t heap=0;heap<heapCount();heap++){
+            heapBudget[heap]=std::min<uint64_t>(budgets.heapBudget[heap],limit);
+            refreshedUsage[heap]=budgets.heapUsage[heap];
+            refreshedCharge[heap]=chargedBytes[heap];
+        }
+        return;
+    }
+    for(uint32_t heap=0;heap<heapCount();heap++){
+        uint64_t share=static_cast<uint64_t>(memoryProperties.memoryHeaps[heap].size*defaultShare);
+        heapBudget[heap]=std::min(share,limit);
+    }
+}
+
+uint64_t ResidencyManager::budget(uint32_t heap) const{
+    return heapBudget[heap];
+}
+
+uint64_t ResidencyManager::usage(uint32_t heap) const{
+    if(!memoryBudget) return chargedBytes[heap];
+    // The extension is only re-read once per frame, allocations and
+    // frees since then are added on top of its last figure.
+    if(chargedBytes[heap]>=refreshedCharge[heap]){
+        return refreshedUsage[heap]+(chargedBytes[heap]-refreshedCharge[heap]);
+    }
+    uint64_t freed=refreshedCharge[heap]-chargedBytes[heap];
+    return refreshedUsage[heap]-std::min(refreshedUsage[heap],freed);
+}
+
+uint32_t ResidencyManager::memoryType(
+    uint32_t typeBits,
+    vk::MemoryPropertyFlags required,
+    vk::MemoryPropertyFlags preferred,
+    vk::DeviceSize size
+) const{
+    // Preferred flags on a heap with room beat any type with room,
+    // which beats the type whose heap is least over its budget.
+    uint32_t best=VK_MAX_MEMORY_TYPES;
+    int32_t bestScore=-1;
+    uint64_t bestHeadroom=0;
+    for(uint32_t type=0;type<memoryProperties.memoryTypeCount;type++){
+        vk::MemoryPropertyFlags flags=memoryProperties.memoryTypes[type].propertyFlags;
+        if(!(typeBits & (1u<<type)) || (flags & required)!=required) continue;
+        uint32_t heap=memoryProperties.memoryTypes[type].heapIndex;
+        uint64_t used=usage(heap)+size;
+        uint64_t limit=static_cast<uint64_t>(budget(heap)*highWater);
+        uint64_t headroom=limit>used?limit-used:0;
+        bool fits=used<=limit;
+        int32_t score=(fits?2:0)+((flags & preferred)==preferred?1:0);
+        if(score>bestScore || (score==bestScore && !fits && headroom>bestHeadroom)){
+            best=type;
+            bestScore=score;
+            bestHeadroom=headroom;
+        }
+    }
+    if(best==VK_MAX_MEMORY_TYPES) throw std::runtime_error("failed to find suitable memory type!");
+    return best;
+}
+
+vk::raii::DeviceMemory ResidencyManager::allocate(
+    const vk::raii::Device& device,
+    const vk::MemoryRequirements& requirements,
+    vk::MemoryPropertyFlags required,
+    vk::MemoryPropertyFlags preferred,
+    MemoryCharge& charge,
+    vk::Optional<const vk::AllocationCallbacks> allocator
+){
+    uint32_t type=memoryType(requirements.memoryTypeBits,required,preferred,requirements.size);
+    uint32_t heap=memoryProperties.memoryTypes[type].heapIndex;
+    if(!makeRoom(heap,requirements.size,highWater)){
+        failures++;
+        throw std::runtime_error("Device memory budget exceeded");
+    }
+
+    vk::MemoryAllocateInfo allocInfo(requirements.size,type);
+    vk::raii::DeviceMemory memory{nullptr};
+    while(true){
+        try{
+            memory=device.allocateMemory(allocInfo,allocator);
+            break;
+        }catch(const vk::OutOfDeviceMemoryError&){
+            // The budget is only an estimate and other processes can
+            // take the rest of the heap. Evicted residents are usually
+            // retired rather than freed, so those go first, then the
+            // residents one by one.
+            if(reclaim && reclaim()) continue;
+            if(!evictOldest(heap)){
+                failures++;
+                throw std::runtime_error("Out of device memory");
+            }
+        }
+    }
+
+    if(charge.owner && charge.owner!=this) charge.release();
+    charge.owner=this;
+    charge.heapBytes[heap]+=requirements.size;
+    chargedBytes[heap]+=requirements.size;
+    peakBytes[heap]=std::max(peakBytes[heap],chargedBytes[heap]);
+    return memory;
+}
+
+bool ResidencyManager::makeRoom(uint32_t heap,vk::DeviceSize size,double share){
+    uint64_t limit=static_cast<uint64_t>(budget(heap)*share);
+    uint64_t used=usage(heap);
+    while(used+size>limit){
+        uint64_t freed=0;
+        if(!evictOldest(heap,&freed)) return used+size<=budget(heap);
+        // Owners that destroy at once already lowered usage(), retired
+        // resources are counted as freed ahead of time.
+        used=std::min(usage(heap),used-std::min(used,freed));
+    }
+    return true;
+}
+
+bool ResidencyManager::evictOldest(uint32_t heap,uint64_t* freed){
+    // Only residents holding memory on this heap help.
+    auto it=std::find_if(lru.rbegin(),lru.rend(),[&](const Resident& resident){
+        return resident.heapBytes[heap]>0;
+    });
+    if(it==lru.rend()) return false;
+    if(freed) *freed=it->heapBytes[heap];
+    std::function<void()> evict=std::move(it->evict);
+    residents.erase(it->id);
+    lru.erase(std::next(it).base());
+    evictions++;
+    evict();
+    return true;
+}
+
+void ResidencyManager::release(const std::array<uint64_t,VK_MAX_MEMORY_HEAPS>& heapBytes){
+    for(uint32_t heap=0;heap<VK_MAX_MEMORY_HEAPS;heap++){
+        chargedBytes[heap]-=std::min(chargedBytes[heap],heapBytes[heap]);
+    }
+}
+
+uint64_t ResidencyManager::addResident(
+    std::initializer_list<const MemoryCharge*> charges,
+    std::function<void()> evict
+){
+    Resident resident{nextResident++,{},std::move(evict)};
+    for(const MemoryCharge* charge:charges){
+        for(uint32_t heap=0;heap<VK_MAX_MEMORY_HEAPS;heap++){
+            resident.heapBytes[heap]+=charge->heapBytes[heap];
+        }
+    }
+    lru.push_front(std::move(resident));
+    residents[lru.front().id]=lru.begin();
+    return lru.front().id;
+}
+
+void ResidencyManager::touch(uint64_t resident){
+    auto it=residents.find(resident);
+    if(it!=residents.end()) lru.splice(lru.begin(),lru,it->second);
+}
+
+void ResidencyManager::removeResident(uint64_t resident){
+    auto it=residents.find(resident);
+    if(it==residents.end()) return;
+    lru.erase(it->second);
+    residents.erase(it);
+}
+
+bool ResidencyManager::evictOldest(){
+    if(lru.empty()) return false;
+    std::function<void()> evict=std::move(lru.back().evict);
+    residents.erase(lru.back().id);
+    lru.pop_back();
+    evictions++;
+    evict();
+    return true;
+}
+
+void ResidencyManager::trim(){
+    refresh();
+    for(uint32_t heap=0;heap<heapCount();heap++){
+        if(usage(heap)>budget(heap)*highWater) makeRoom(heap,0,lowWater);
+    }
+}
+
+void ResidencyManager::report(std::ostream& out) const{
+    out<<std::fixed<<std::setprecision(1)
+       <<"device memory ("<<(memoryBudget?"VK_EXT_memory_budget":"static budget")<<"): "
+       <<lru.size()<<" residents, "<<evictions<<" evictions, "<<failures<<" failed allocations\n";
+    for(uint32_t heap=0;heap<heapCount();heap++){
+        bool local=static_cast<bool>(memoryProperties.memoryHeaps[heap].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+        out<<"  heap "<<heap<<(local?" device":" host  ")
+           <<std::setw(9)<<toMb(chargedBytes[heap])<<" MB charged "
+           <<std::setw(9)<<toMb(peakBytes[heap])<<" MB peak "
+           <<std::setw(9)<<toMb(usage(heap))<<" MB used of "
+           <<std::setw(9)<<toMb(budget(heap))<<" MB\n";
+    }
+    out<<std::defaultfloat;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <vulkan/vulkan_raii.hpp>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iosfwd>
+#include <list>
+#include <unordered_map>
+
+class ResidencyManager;
+
+// Device memory charged to its heaps for as long as the object holding
+// it lives. Kept next to the vk::raii::DeviceMemory it accounts for and
+// destroyed together with it, e.g. when a retired mesh is collected.
+class MemoryCharge{
+public:
+    MemoryCharge()=default;
+    ~MemoryCharge();
+    MemoryCharge(MemoryCharge&& other) noexcept;
+    MemoryCharge& operator=(MemoryCharge&& other) noexcept;
+    MemoryCharge(const MemoryCharge&)=delete;
+    MemoryCharge& operator=(const MemoryCharge&)=delete;
+
+    uint64_t bytes() const;
+
+private:
+    friend class ResidencyManager;
+    void release();
+
+    ResidencyManager* owner=nullptr;
+    std::array<uint64_t,VK_MAX_MEMORY_HEAPS> heapBytes{};
+};
+
+// Keeps device memory use within a budget per heap. The budget comes
+// from VK_EXT_memory_budget when the device has it, or is a share of
+// each heap's size otherwise; a configured limit caps both, so several
+// instances sharing a GPU each stay within their own.
+//
+// Allocations made through allocate() are charged to their heap and
+// pick, among the memory types that fit, one on a heap with room left.
+// Caches register what they could drop as residents; when a heap gets
+// close to its budget the least recently used residents are evicted
+// until it is back under lowWater of it. Not thread-safe, allocations
+// and eviction happen on the frame loop's thread.
+class ResidencyManager{
+public:
+    static constexpr double highWater=0.9;
+    static constexpr double lowWater=0.75;
+    // Share of a heap's size used as its budget without the extension.
+    static constexpr double defaultShare=0.8;
+
+    // apiVersion is the instance's, on 1.0 the extension's figures are
+    // read through VK_KHR_get_physical_device_properties2 when enabled
+    // and the static budget is used otherwise.
+    ResidencyManager(
+        const vk::raii::PhysicalDevice& physicalDevice,
+        uint32_t apiVersion,
+        bool memoryBudget,
+        uint64_t byteLimit=0
+    );
+    ResidencyManager(const ResidencyManager&)=delete;
+    ResidencyManager& operator=(const ResidencyManager&)=delete;
+
+    // Memory type for a resource, or throws when none has required.
+    // Types with preferred flags win when their heap has room.
+    uint32_t memoryType(
+        uint32_t typeBits,
+        vk::MemoryPropertyFlags required,
+        vk::MemoryPropertyFlags preferred={},
+        vk::DeviceSize size=0
+    ) const;
+    // Evicts residents when the allocation would push its heap past
+    // highWater. If the driver still runs out of memory it reclaims
+    // retired resources and evicts one resident at a time, throwing
+    // std::runtime_error once neither is left.
+    vk::raii::DeviceMemory allocate(
+        const vk::raii::Device& device,
+        const vk::MemoryRequirements& requirements,
+        vk::MemoryPropertyFlags required,
+        vk::MemoryPropertyFlags preferred,
+        MemoryCharge& charge,
+        vk::Optional<const vk::AllocationCallbacks> allocator=nullptr
+    );
+
+    // Frees resources that only wait for the GPU, such as a RetireQueue
+    // with evicted residents in it; false when there were none.
+    void setReclaim(std::function<bool()> reclaim);
+    // evict has to drop the resident's resources, at once or through a
+    // RetireQueue; it is never called after removeResident().
+    uint64_t addResident(
+        std::initializer_list<const MemoryCharge*> charges,
+        std::function<void()> evict
+    );
+    void touch(uint64_t resident);
+    void removeResident(uint64_t resident);
+    // Drops the least recently used resident, false when there is none.
+    bool evictOldest();
+
+    // Re-reads the extension's budget and usage, then evicts while any
+    // heap is above highWater. Meant to run once per frame.
+    void trim();
+
+    uint32_t heapCount() const{ return memoryProperties.memoryHeapCount; }
+    uint64_t budget(uint32_t heap) const;
+    // What the process uses on heap: the extension's figure when
+    // present, the bytes charged here otherwise.
+    uint64_t usage(uint32_t heap) const;
+    uint64_t charged(uint32_t heap) const{ return chargedBytes[heap]; }
+    void report(std::ostream& out) const;
+
+private:
+    friend class MemoryCharge;
+
+    struct Resident{
+        uint64_t id;
+        std::array<uint64_t,VK_MAX_MEMORY_HEAPS> heapBytes;
+        std::function<void()> evict;
+    };
+
+    void refresh();
+    void release(const std::array<uint64_t,VK_MAX_MEMORY_HEAPS>& heapBytes);
+    // Evicts until heap fits size below share of its budget. Evicted
+    // residents count as freed even if their owner retired them.
+    bool makeRoom(uint32_t heap,vk::DeviceSize size,double share);
+    bool evictOldest(uint32_t heap,uint64_t* freed=nullptr);
+
+    const vk::raii::PhysicalDevice& physicalDevice;
+    bool khrProperties2=false;
+    bool memoryBudget;
+    uint64_t byteLimit;
+    vk::PhysicalDeviceMemoryProperties memoryProperties;
+    std::array<uint64_t,VK_MAX_MEMORY_HEAPS> heapBudget{};
+    // Extension usage at the last refresh and what was charged then,
+    // usage() adds what was charged since.
+    std::array<uint64_t,VK_MAX_MEMORY_HEAPS> refreshedUsage{};
+    std::array<uint64_t,VK_MAX_MEMORY_HEAPS> refreshedCharge{};
+    std::array<uint64_t,VK_MAX_MEMORY_HEAPS> chargedBytes{};
+    std::array<uint64_t,VK_MAX_MEMORY_HEAPS> peakBytes{};
+    uint64_t evictions=0;
+    uint64_t failures=0;
+    std::function<bool()> reclaim;
+
+    uint64_t nextResident=1;
+    // Front is the most recently used resident.
+    std::list<Resident> lru;
+    std::unordered_map<uint64_t,std::list<Resident>::iterator> residents;
+};
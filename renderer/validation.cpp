@@ -0,0 +1,289 @@
+#include "validation.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace{
+    const auto drainInterval=std::chrono::milliseconds(10);
+    const auto repeatInterval=std::chrono::seconds(1);
+    const size_t maxProbes=16;
+
+    uint64_t hashText(const char* text){
+        uint64_t hash=1469598103934665603ull;
+        for(;*text;text++){
+            hash^=static_cast<unsigned char>(*text);
+            hash*=1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Repeats of one id are folded together, so the key prefers the
+    // id name, then the id number and only then the full text.
+    uint64_t messageKey(const VkDebugUtilsMessengerCallbackDataEXT* data){
+        uint64_t key;
+        if(data->pMessageIdName) key=hashText(data->pMessageIdName);
+        else if(data->messageIdNumber) key=static_cast<uint32_t>(data->messageIdNumber);
+        else key=hashText(data->pMessage?data->pMessage:"");
+        // Zero marks an empty slot in the seen table.
+        return key|1;
+    }
+
+    // The objects an error names, so one broken object does not hide
+    // the next one hitting the same id.
+    uint64_t objectKey(const VkDebugUtilsMessengerCallbackDataEXT* data){
+        uint64_t key=1469598103934665603ull;
+        for(uint32_t i=0;i<data->objectCount;i++){
+            key=(key^data->pObjects[i].objectHandle)*1099511628211ull;
+        }
+        return key|1;
+    }
+
+    void copyText(char* dst,size_t size,const char* src){
+        if(!src){
+            dst[0]='\0';
+            return;
+        }
+        size_t length=std::min(std::strlen(src),size-1);
+        std::memcpy(dst,src,length);
+        dst[length]='\0';
+    }
+
+    const char* severityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity){
+        switch(severity){
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT: return "error";
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT: return "warning";
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT: return "info";
+            default: return "verbose";
+        }
+    }
+
+    const char* typeName(VkDebugUtilsMessageTypeFlagsEXT type){
+        if(type&VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT) return "validation";
+        if(type&VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) return "performance";
+        return "general";
+    }
+}
+
+ValidationLog::ValidationLog(std::ostream& out):out(out){
+    severityMask=static_cast<uint32_t>(
+        VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+        VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT
+    );
+    typeMask=static_cast<uint32_t>(
+        VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+        VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+        VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT
+    );
+    for(size_t i=0;i<ringSize;i++){
+        ring[i].sequence.store(i,std::memory_order_relaxed);
+    }
+    drainer=std::thread(&ValidationLog::run,this);
+}
+
+ValidationLog::~ValidationLog(){
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        stop=true;
+    }
+    wake.notify_all();
+    drainer.join();
+}
+
+ValidationLog& ValidationLog::shared(){
+    static ValidationLog log(std::cerr);
+    return log;
+}
+
+void ValidationLog::setSeverities(vk::DebugUtilsMessageSeverityFlagsEXT severities){
+    severityMask.store(static_cast<uint32_t>(severities),std::memory_order_relaxed);
+}
+
+void ValidationLog::setTypes(vk::DebugUtilsMessageTypeFlagsEXT types){
+    typeMask.store(static_cast<uint32_t>(types),std::memory_order_relaxed);
+}
+
+vk::DebugUtilsMessageSeverityFlagsEXT ValidationLog::severities() const{
+    return vk::DebugUtilsMessageSeverityFlagsEXT(severityMask.load(std::memory_order_relaxed));
+}
+
+vk::DebugUtilsMessageTypeFlagsEXT ValidationLog::types() const{
+    return vk::DebugUtilsMessageTypeFlagsEXT(typeMask.load(std::memory_order_relaxed));
+}
+
+uint64_t ValidationLog::received() const{
+    return receivedCount.load(std::memory_order_relaxed);
+}
+
+uint64_t ValidationLog::dropped() const{
+    return droppedCount.load(std::memory_order_relaxed);
+}
+
+uint64_t ValidationLog::undeduplicated() const{
+    return undeduplicatedCount.load(std::memory_order_relaxed);
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL ValidationLog::callback(
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT type,
+    const VkDebugUtilsMessengerCallbackDataEXT* data,
+    void* userData
+){
+    static_cast<ValidationLog*>(userData)->push(severity,type,data);
+    return VK_FALSE;
+}
+
+ValidationLog::Seen* ValidationLog::track(uint64_t key){
+    size_t index=static_cast<size_t>(key>>1)%seenSize;
+    for(size_t probe=0;probe<maxProbes;probe++){
+        Seen& entry=seen[(index+probe)%seenSize];
+        uint64_t current=entry.key.load(std::memory_order_acquire);
+        if(current==0) entry.key.compare_exchange_strong(current,key,std::memory_order_acq_rel);
+        if(current==0 || current==key){
+            entry.count.fetch_add(1,std::memory_order_relaxed);
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+std::atomic<uint64_t>* ValidationLog::claimObject(Seen& entry,uint64_t object){
+    for(std::atomic<uint64_t>& slot:entry.objects){
+        uint64_t current=slot.load(std::memory_order_acquire);
+        if(current==0 && slot.compare_exchange_strong(current,object,std::memory_order_acq_rel)) return &slot;
+        if(current==object) return nullptr;
+    }
+    // Objects past the first few are only counted, a churning app
+    // would otherwise print the same error every frame.
+    return nullptr;
+}
+
+void ValidationLog::push(
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT type,
+    const VkDebugUtilsMessengerCallbackDataEXT* data
+){
+    if(!(severityMask.load(std::memory_order_relaxed)&severity)) return;
+    if(!(typeMask.load(std::memory_order_relaxed)&type)) return;
+    receivedCount.fetch_add(1,std::memory_order_relaxed);
+
+    uint64_t key=messageKey(data);
+    Seen* entry=track(key);
+    // Table is crowded around this key, let it through undeduplicated.
+    if(!entry){
+        undeduplicatedCount.fetch_add(1,std::memory_order_relaxed);
+        enqueue(key,1,severity,type,data);
+        return;
+    }
+    if(severity==VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT){
+        std::atomic<uint64_t>* object=claimObject(*entry,objectKey(data));
+        if(!object) return;
+        uint64_t count=entry->count.load(std::memory_order_relaxed);
+        if(!enqueue(key,count,severity,type,data)) object->store(0,std::memory_order_release);
+        return;
+    }
+    // Only the first occurrence is queued, later ones are just counted.
+    bool queued=false;
+    if(!entry->queued.compare_exchange_strong(queued,true,std::memory_order_acq_rel)) return;
+    uint64_t count=entry->count.load(std::memory_order_relaxed);
+    if(!enqueue(key,count,severity,type,data)) entry->queued.store(false,std::memory_order_release);
+}
+
+bool ValidationLog::enqueue(
+    uint64_t key,
+    uint64_t count,
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT type,
+    const VkDebugUtilsMessengerCallbackDataEXT* data
+){
+    // Bounded multi-producer queue: a slot is free for position pos
+    // when its sequence equals pos, and readable once it is pos+1.
+    size_t pos=enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    while(true){
+        slot=&ring[pos%ringSize];
+        size_t sequence=slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff=static_cast<intptr_t>(sequence)-static_cast<intptr_t>(pos);
+        if(diff==0){
+            if(enqueuePos.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed)) break;
+        }else if(diff<0){
+            droppedCount.fetch_add(1,std::memory_order_relaxed);
+            return false;
+        }else{
+            pos=enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    Message& message=slot->message;
+    message.key=key;
+    message.count=count;
+    message.severity=severity;
+    message.type=type;
+    copyText(message.name,nameSize,data->pMessageIdName);
+    copyText(message.text,textSize,data->pMessage);
+    slot->sequence.store(pos+1,std::memory_order_release);
+    return true;
+}
+
+bool ValidationLog::pop(Message& message){
+    Slot& slot=ring[dequeuePos%ringSize];
+    if(slot.sequence.load(std::memory_order_acquire)!=dequeuePos+1) return false;
+    message=slot.message;
+    slot.sequence.store(dequeuePos+ringSize,std::memory_order_release);
+    dequeuePos++;
+    return true;
+}
+
+void ValidationLog::drain(){
+    Message message;
+    bool wrote=false;
+    while(pop(message)){
+        // Errors for further objects of the same id are printed too,
+        // their occurrences are not repeats.
+        auto [it,inserted]=repeats.try_emplace(message.key,Repeat{message.name,message.count});
+        if(!inserted) it->second.reported=std::max(it->second.reported,message.count);
+        out<<"validation layer ["<<severityName(message.severity)<<"/"
+           <<typeName(message.type)<<"]: "<<message.text<<'\n';
+        wrote=true;
+    }
+    if(wrote) out.flush();
+}
+
+void ValidationLog::reportRepeats(){
+    bool wrote=false;
+    for(Seen& entry:seen){
+        uint64_t key=entry.key.load(std::memory_order_acquire);
+        if(key==0) continue;
+        uint64_t count=entry.count.load(std::memory_order_relaxed);
+        // The first message may still be in the ring.
+        auto it=repeats.find(key);
+        if(it==repeats.end() || count<=it->second.reported) continue;
+        out<<"validation layer: "
+           <<(it->second.name.empty()?"message":it->second.name)
+           <<" repeated "<<count-it->second.reported<<" more times\n";
+        it->second.reported=count;
+        wrote=true;
+    }
+    if(wrote) out.flush();
+}
+
+void ValidationLog::run(){
+    auto lastReport=std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(stopMutex);
+    while(true){
+        bool stopping=wake.wait_for(lock,drainInterval,[this]{ return stop; });
+        drain();
+        auto now=std::chrono::steady_clock::now();
+        if(stopping || now-lastReport>=repeatInterval){
+            reportRepeats();
+            lastReport=now;
+        }
+        if(stopping){
+            if(uint64_t lost=dropped()) out<<"validation layer: "<<lost<<" messages dropped\n";
+            if(uint64_t plain=undeduplicated()){
+                out<<"validation layer: "<<plain<<" messages not deduplicated, too many distinct ids\n";
+            }
+            out.flush();
+            return;
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <vulkan/vulkan_raii.hpp>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Sink for VK_EXT_debug_utils messages. The callback runs on whatever
+// thread made the API call, so it only filters, bumps a counter for
+// message ids it has already seen and copies new messages into a
+// bounded lock-free ring. An error is printed again for each of the
+// first few objects that hit its id. A background thread formats and
+// prints them and periodically reports how often each repeated id
+// fired.
+class ValidationLog{
+public:
+    explicit ValidationLog(std::ostream& out);
+    ~ValidationLog();
+    ValidationLog(const ValidationLog&)=delete;
+    ValidationLog& operator=(const ValidationLog&)=delete;
+
+    // The log the messengers made by vo::create report to, writes to
+    // std::cerr.
+    static ValidationLog& shared();
+
+    // Messengers are created with every severity and type enabled,
+    // these masks decide what is kept and can change at any time.
+    void setSeverities(vk::DebugUtilsMessageSeverityFlagsEXT severities);
+    void setTypes(vk::DebugUtilsMessageTypeFlagsEXT types);
+    vk::DebugUtilsMessageSeverityFlagsEXT severities() const;
+    vk::DebugUtilsMessageTypeFlagsEXT types() const;
+
+    // Messages that passed the filters, including repeats.
+    uint64_t received() const;
+    // Messages lost because the ring was full.
+    uint64_t dropped() const;
+    // Messages queued without deduplication, the seen table was full.
+    uint64_t undeduplicated() const;
+
+    static VKAPI_ATTR VkBool32 VKAPI_CALL callback(
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+        VkDebugUtilsMessageTypeFlagsEXT type,
+        const VkDebugUtilsMessengerCallbackDataEXT* data,
+        void* userData
+    );
+
+private:
+    static constexpr size_t ringSize=256;
+    static constexpr size_t seenSize=1024;
+    static constexpr size_t textSize=1024;
+    static constexpr size_t nameSize=64;
+    static constexpr size_t objectsPerId=8;
+
+    struct Message{
+        uint64_t key;
+        // Occurrences of key when it was queued.
+        uint64_t count;
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+        VkDebugUtilsMessageTypeFlagsEXT type;
+        char name[nameSize];
+        char text[textSize];
+    };
+    struct Slot{
+        std::atomic<size_t> sequence;
+        Message message;
+    };
+    struct Seen{
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint64_t> count{0};
+        // Set once a message with key is in the ring, cleared again
+        // when the ring was full so the next occurrence retries.
+        std::atomic<bool> queued{false};
+        // Objects whose errors with key were queued, zero when unused.
+        std::array<std::atomic<uint64_t>,objectsPerId> objects{};
+    };
+    struct Repeat{
+        std::string name;
+        uint64_t reported;
+    };
+
+    void push(
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+        VkDebugUtilsMessageTypeFlagsEXT type,
+        const VkDebugUtilsMessengerCallbackDataEXT* data
+    );
+    // Counts key, nullptr when the table is too crowded around it.
+    Seen* track(uint64_t key);
+    // The slot taken for object, nullptr when it is already listed or
+    // the list is full.
+    std::atomic<uint64_t>* claimObject(Seen& entry,uint64_t object);
+    bool enqueue(
+        uint64_t key,
+        uint64_t count,
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+        VkDebugUtilsMessageTypeFlagsEXT type,
+        const VkDebugUtilsMessengerCallbackDataEXT* data
+    );
+    bool pop(Message& message);
+    void drain();
+    void reportRepeats();
+    void run();
+
+    std::ostream& out;
+    std::atomic<uint32_t> severityMask;
+    std::atomic<uint32_t> typeMask;
+    std::atomic<uint64_t> receivedCount{0};
+    std::atomic<uint64_t> droppedCount{0};
+    std::atomic<uint64_t> undeduplicatedCount{0};
+
+    std::array<Slot,ringSize> ring;
+    std::atomic<size_t> enqueuePos{0};
+    size_t dequeuePos=0;
+    std::array<Seen,seenSize> seen;
+
+    // Only touched by the drain thread.
+    std::unordered_map<uint64_t,Repeat> repeats;
+
+    std::mutex stopMutex;
+    std::condition_variable wake;
+    bool stop=false;
+    std::thread drainer;
+};